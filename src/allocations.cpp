@@ -0,0 +1,28 @@
+/// @file allocations.cpp
+/// Replaces the global `operator new` by one that counts the allocations of
+/// each thread. Only the test binary links this file (see the Makefile), so
+/// that the engine itself allocates as usual.
+
+#include <cstdlib>
+#include <new>
+
+#include "test.h"
+
+namespace {
+
+thread_local std::size_t allocations = 0;
+
+std::size_t countAllocations() { return allocations; }
+
+[[maybe_unused]] const bool registered =
+    (Dagor::Test::allocationCount = countAllocations, true);
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+  allocations++;
+  if (void* memory = std::malloc(size == 0 ? 1 : size)) return memory;
+  throw std::bad_alloc{};
+}
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
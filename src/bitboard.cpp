@@ -2,6 +2,10 @@
 
 #include <ios>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 namespace Dagor::BitBoards {
 
 std::ostream &operator<<(std::ostream &out, const BitBoard &board) {
@@ -23,4 +27,109 @@ std::ostream &operator<<(std::ostream &out, const BitBoard &board) {
   return out;
 }
 
+namespace {
+
+constexpr std::uint64_t notAFile = 0xfefefefefefefefeULL;
+constexpr std::uint64_t notHFile = 0x7f7f7f7f7f7f7f7fULL;
+
+/// @brief Kogge-Stone occluded fill of `sliders` through `empty` in the
+/// direction of `shift` (positive: up the board, negative: down), followed by
+/// one more step, so that the first blocker is attacked as well. `wrap` masks
+/// out the squares that a step in this direction cannot reach without
+/// wrapping around the side of the board.
+std::uint64_t directionAttacks(std::uint64_t sliders, std::uint64_t empty,
+                               int shift, std::uint64_t wrap) {
+  auto step = [shift](std::uint64_t b, int times) {
+    return shift > 0 ? b << (shift * times) : b >> (-shift * times);
+  };
+  std::uint64_t propagators = empty & wrap;
+  sliders |= propagators & step(sliders, 1);
+  propagators &= step(propagators, 1);
+  sliders |= propagators & step(sliders, 2);
+  propagators &= step(propagators, 2);
+  sliders |= propagators & step(sliders, 4);
+  return step(sliders, 1) & wrap;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2"))) inline __m256i step(__m256i b, __m256i shift,
+                                                    bool up) {
+  return up ? _mm256_sllv_epi64(b, shift) : _mm256_srlv_epi64(b, shift);
+}
+
+/// @brief The same fill, for four directions at once: one per 64-bit lane.
+__attribute__((target("avx2"))) __m256i fillLanes(__m256i sliders,
+                                                  __m256i empty,
+                                                  __m256i shift,
+                                                  __m256i wrap, bool up) {
+  __m256i shift2 = _mm256_add_epi64(shift, shift);
+  __m256i shift4 = _mm256_add_epi64(shift2, shift2);
+  __m256i propagators = _mm256_and_si256(empty, wrap);
+  sliders = _mm256_or_si256(
+      sliders, _mm256_and_si256(propagators, step(sliders, shift, up)));
+  propagators = _mm256_and_si256(propagators, step(propagators, shift, up));
+  sliders = _mm256_or_si256(
+      sliders, _mm256_and_si256(propagators, step(sliders, shift2, up)));
+  propagators = _mm256_and_si256(propagators, step(propagators, shift2, up));
+  sliders = _mm256_or_si256(
+      sliders, _mm256_and_si256(propagators, step(sliders, shift4, up)));
+  return _mm256_and_si256(step(sliders, shift, up), wrap);
+}
+
+__attribute__((target("avx2"))) BitBoard slidingAttacksAvx2(
+    BitBoard orthogonal, BitBoard diagonal, BitBoard empty) {
+  auto o = static_cast<long long>(orthogonal.asUint());
+  auto d = static_cast<long long>(diagonal.asUint());
+  auto a = static_cast<long long>(notAFile);
+  auto h = static_cast<long long>(notHFile);
+  // lanes: north, east, north-east, north-west and their opposites
+  __m256i sliders = _mm256_set_epi64x(d, d, o, o);
+  __m256i shifts = _mm256_set_epi64x(7, 9, 1, 8);
+  __m256i all = _mm256_set1_epi64x(static_cast<long long>(empty.asUint()));
+  __m256i up = fillLanes(sliders, all, shifts, _mm256_set_epi64x(h, a, a, -1),
+                         true);
+  __m256i down = fillLanes(sliders, all, shifts,
+                           _mm256_set_epi64x(a, h, h, -1), false);
+  __m256i both = _mm256_or_si256(up, down);
+  __m128i half = _mm_or_si128(_mm256_castsi256_si128(both),
+                              _mm256_extracti128_si256(both, 1));
+  half = _mm_or_si128(half, _mm_unpackhi_epi64(half, half));
+  return {static_cast<std::uint64_t>(_mm_cvtsi128_si64(half))};
+}
+#endif
+
+using SlidingAttacks = BitBoard (*)(BitBoard, BitBoard, BitBoard);
+
+SlidingAttacks selectSlidingAttacks() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    return slidingAttacksAvx2;
+  }
+#endif
+  return slidingAttacksScalar;
+}
+
+const SlidingAttacks dispatchedSlidingAttacks = selectSlidingAttacks();
+
+}  // namespace
+
+BitBoard slidingAttacksScalar(BitBoard orthogonal, BitBoard diagonal,
+                              BitBoard empty) {
+  std::uint64_t o = orthogonal.asUint();
+  std::uint64_t d = diagonal.asUint();
+  std::uint64_t e = empty.asUint();
+  return {directionAttacks(o, e, 8, ~0ULL) | directionAttacks(o, e, -8, ~0ULL) |
+          directionAttacks(o, e, 1, notAFile) |
+          directionAttacks(o, e, -1, notHFile) |
+          directionAttacks(d, e, 9, notAFile) |
+          directionAttacks(d, e, 7, notHFile) |
+          directionAttacks(d, e, -7, notAFile) |
+          directionAttacks(d, e, -9, notHFile)};
+}
+
+BitBoard slidingAttacks(BitBoard orthogonal, BitBoard diagonal,
+                        BitBoard empty) {
+  return dispatchedSlidingAttacks(orthogonal, diagonal, empty);
+}
+
 }  // namespace Dagor::BitBoards
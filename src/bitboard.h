@@ -33,10 +33,10 @@ class BitBoard {
 
  public:
   /// @brief constructs an empty BitBoard.
-  BitBoard() : board{0} {}
+  constexpr BitBoard() : board{0} {}
   /// @brief
   /// @param bitboard a uint64 as returned by the `asUint` function.
-  BitBoard(std::uint64_t bitboard) : board{bitboard} {}
+  constexpr BitBoard(std::uint64_t bitboard) : board{bitboard} {}
 
   /// @brief
   /// @return a uint64 where all the 1 bits indicate the set squares
@@ -105,6 +105,13 @@ class BitBoard {
   constexpr Square::t findFirstSet() const {
     return static_cast<Square::t>(__builtin_ctzll(board));
   }
+
+  /// @brief Finds the index of the last set square in the bitboard.
+  /// Do not call this function for the empty bitboard.
+  /// @return the index of the last set square.
+  constexpr Square::t findLastSet() const {
+    return static_cast<Square::t>(63 - __builtin_clzll(board));
+  }
   class Iterator {
    private:
     std::uint64_t board;
@@ -225,6 +232,49 @@ inline const BitBoard edgesOnly{0xff818181818181ff};
 
 inline const BitBoard all{0xffffffffffffffff};
 
+/// @brief The union of the attacks of many sliders at once, by Kogge-Stone
+/// occluded fills in all eight directions. Uses AVX2 (four directions per
+/// instruction) if the CPU supports it, `slidingAttacksScalar` otherwise.
+/// @param orthogonal the sliders moving along ranks and files (rooks,
+/// queens).
+/// @param diagonal the sliders moving along diagonals (bishops, queens).
+/// @param empty the squares the sliders can move through.
+/// @return every square some slider attacks, blockers included.
+BitBoard slidingAttacks(BitBoard orthogonal, BitBoard diagonal,
+                        BitBoard empty);
+/// @brief The portable fallback of `slidingAttacks`.
+BitBoard slidingAttacksScalar(BitBoard orthogonal, BitBoard diagonal,
+                              BitBoard empty);
+
+/// @brief Moves all squares of a bitboard by the same offset. Squares that
+/// would leave the board at the top or bottom are dropped; wrapping around
+/// the sides has to be masked out by the caller.
+/// @param board the squares to move.
+/// @param offset the offset in square indices, e. g. `Square::north`.
+/// @return the moved bitboard.
+inline BitBoard shift(BitBoard board, int offset) {
+  if (offset >= 0) {
+    return {board.asUint() << offset};
+  } else {
+    return {board.asUint() >> -offset};
+  }
+}
+
+/// @brief The squares attacked by all the given pawns at once.
+/// @param pawns the squares of the pawns.
+/// @param color the color of the pawns, which gives their direction.
+/// @return the union of the squares attacked by the pawns.
+inline BitBoard pawnAttacks(BitBoard pawns, Color::t color) {
+  std::uint64_t notAFile = ~wholeFile(0).asUint();
+  std::uint64_t notHFile = ~wholeFile(7).asUint();
+  std::uint64_t p = pawns.asUint();
+  if (color == Color::white) {
+    return {((p & notAFile) << 7) | ((p & notHFile) << 9)};
+  } else {
+    return {((p & notAFile) >> 9) | ((p & notHFile) >> 7)};
+  }
+}
+
 }  // namespace Dagor::BitBoards
 
 #endif
\ No newline at end of file
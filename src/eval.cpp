@@ -1,11 +1,21 @@
 #include "eval.h"
 
+#include <algorithm>
 #include <array>
+#include <cassert>
+#include <limits>
+#include <optional>
 
+#include "movetables.h"
+#include "nnue.h"
+#include "pawns.h"
+#include "tablebases.h"
 #include "types.h"
 
 namespace Dagor::Eval {
 
+/// @brief The piece-square tables, drawn as seen from white: rank 8 comes
+/// first.
 constexpr std::array<std::int8_t, Square::size * Piece::all.size()>
     opening_table = {
         /* Pawns */
@@ -69,29 +79,427 @@ constexpr std::array<std::int8_t, Square::size * Piece::all.size()>
         20, 30, 10, 0, 0, 10, 30, 20,            //
 };
 
-int eval(const GameState& state) {
-  int result = 0;
+constexpr std::array<std::int8_t, Square::size * Piece::all.size()>
+    endgame_table = {
+        /* Pawns */
+        0, 0, 0, 0, 0, 0, 0, 0,          //
+        80, 80, 80, 80, 80, 80, 80, 80,  //
+        50, 50, 50, 50, 50, 50, 50, 50,  //
+        30, 30, 30, 30, 30, 30, 30, 30,  //
+        15, 15, 15, 15, 15, 15, 15, 15,  //
+        5, 5, 5, 5, 5, 5, 5, 5,          //
+        0, 0, 0, 0, 0, 0, 0, 0,          //
+        0, 0, 0, 0, 0, 0, 0, 0,          //
 
-  for (Piece::t piece : Piece::nonKing) {
-    BitBoards::BitBoard ourPieces = state.forPiece(piece, state.us());
-    BitBoards::BitBoard opponentPieces = state.forPiece(piece, state.them());
+        /* Knights */
+        -50, -40, -30, -30, -30, -30, -40, -50,  //
+        -40, -20, 0, 0, 0, 0, -20, -40,          //
+        -30, 0, 10, 15, 15, 10, 0, -30,          //
+        -30, 0, 15, 20, 20, 15, 0, -30,          //
+        -30, 0, 15, 20, 20, 15, 0, -30,          //
+        -30, 0, 10, 15, 15, 10, 0, -30,          //
+        -40, -20, 0, 0, 0, 0, -20, -40,          //
+        -50, -40, -30, -30, -30, -30, -40, -50,  //
 
-    /* Material */
-    int diff = ourPieces.populationCount() - opponentPieces.populationCount();
-    result += diff * Piece::worth[piece];
+        /* Bishops */
+        -20, -10, -10, -10, -10, -10, -10, -20,  //
+        -10, 0, 0, 0, 0, 0, 0, -10,              //
+        -10, 0, 5, 10, 10, 5, 0, -10,            //
+        -10, 0, 10, 15, 15, 10, 0, -10,          //
+        -10, 0, 10, 15, 15, 10, 0, -10,          //
+        -10, 0, 5, 10, 10, 5, 0, -10,            //
+        -10, 0, 0, 0, 0, 0, 0, -10,              //
+        -20, -10, -10, -10, -10, -10, -10, -20,  //
 
-    /* Positions */
-    for (Square::t square : ourPieces) {
-      Square::t forWhite = Square::reverseForColor(square, state.us());
-      result += opening_table[forWhite + piece * Square::size];
+        /* Rooks */
+        0, 0, 0, 0, 0, 0, 0, 0,          //
+        10, 10, 10, 10, 10, 10, 10, 10,  //
+        0, 0, 0, 0, 0, 0, 0, 0,          //
+        0, 0, 0, 0, 0, 0, 0, 0,          //
+        0, 0, 0, 0, 0, 0, 0, 0,          //
+        0, 0, 0, 0, 0, 0, 0, 0,          //
+        0, 0, 0, 0, 0, 0, 0, 0,          //
+        0, 0, 0, 0, 0, 0, 0, 0,          //
+
+        /* Queen */
+        -20, -10, -10, -5, -5, -10, -10, -20,  //
+        -10, 0, 5, 5, 5, 5, 0, -10,            //
+        -10, 5, 10, 10, 10, 10, 5, -10,        //
+        -5, 5, 10, 15, 15, 10, 5, -5,          //
+        -5, 5, 10, 15, 15, 10, 5, -5,          //
+        -10, 5, 10, 10, 10, 10, 5, -10,        //
+        -10, 0, 5, 5, 5, 5, 0, -10,            //
+        -20, -10, -10, -5, -5, -10, -10, -20,  //
+
+        /* King */
+        -50, -40, -30, -20, -20, -30, -40, -50,  //
+        -30, -20, -10, 0, 0, -10, -20, -30,      //
+        -30, -10, 20, 30, 30, 20, -10, -30,      //
+        -30, -10, 30, 40, 40, 30, -10, -30,      //
+        -30, -10, 30, 40, 40, 30, -10, -30,      //
+        -30, -10, 20, 30, 30, 20, -10, -30,      //
+        -30, -30, 0, 0, 0, 0, -30, -30,          //
+        -50, -30, -30, -30, -30, -30, -30, -50,  //
+};
+
+// constexpr, so that it is initialized before any position is set up
+constexpr std::array<
+    std::array<std::array<Score, Square::size>, Piece::all.size()>,
+    Color::size>
+    pieceSquareScores = [] {
+      std::array<std::array<std::array<Score, Square::size>, Piece::all.size()>,
+                 Color::size>
+          scores{};
+      for (Piece::t piece : Piece::all) {
+        for (Square::t square = 0; square < Square::size; square++) {
+          // the tables are drawn with rank 8 first, i. e. flipped for white
+          Square::t index = Square::reverseForColor(square, Color::black);
+          Score score = makeScore(
+              Piece::worth[piece] + opening_table[index + piece * Square::size],
+              Piece::worth[piece] +
+                  endgame_table[index + piece * Square::size]);
+          scores[Color::white][piece][square] = score;
+          scores[Color::black][piece][index] = -score;
+        }
+      }
+      return scores;
+    }();
+
+Score pieceSquareScore(const Position& position) {
+  Score score = 0;
+  for (Color::t color : Color::all) {
+    for (Piece::t piece : Piece::all) {
+      for (Square::t square : position.forPiece(piece, color)) {
+        score += pieceSquare(piece, color, square);
+      }
+    }
+  }
+  return score;
+}
+
+/// @brief Pieces attacked by an enemy pawn, which usually have to move.
+constexpr Score threatenedByPawn = makeScore(-20, -15);
+/// @brief Per relative rank of a passed pawn whose way to the last rank is
+/// not blocked.
+constexpr Score freePasser = makeScore(0, 10);
+/// @brief By piece, per square the piece can move to that is not attacked by
+/// an enemy pawn.
+constexpr std::array<Score, Piece::all.size()> mobilityBonus = {
+    0, makeScore(4, 4), makeScore(4, 5), makeScore(2, 4), makeScore(1, 2), 0};
+/// @brief Per move of an officer to a square next to the enemy king.
+constexpr Score kingZoneAttack = makeScore(6, 1);
+
+/// @brief By officer, the most its terms in `pieceScore` can add: the
+/// mobility of the most squares it can reach on an empty board and
+/// attacks on the most squares next to a king it can reach from one square.
+const std::array<Score, Piece::all.size()> officerBound = [] {
+  std::array<Score, Piece::all.size()> bound{};
+  for (Piece::t piece : Piece::officers) {
+    int mostMoves = 0;
+    int mostKingZoneAttacks = 0;
+    for (Square::t square = 0; square < Square::size; square++) {
+      BitBoards::BitBoard moves = MoveTables::bishopMoves(square, {0});
+      if (piece == Piece::knight) {
+        moves = MoveTables::knightMoves(square);
+      } else if (piece == Piece::rook) {
+        moves = MoveTables::rookMoves(square, {0});
+      } else if (piece == Piece::queen) {
+        moves |= MoveTables::rookMoves(square, {0});
+      }
+      mostMoves = std::max(mostMoves, moves.populationCount());
+      for (Square::t king = 0; king < Square::size; king++) {
+        if (king == square) continue;
+        mostKingZoneAttacks =
+            std::max(mostKingZoneAttacks,
+                     (moves & MoveTables::kingMoves(king)).populationCount());
+      }
     }
+    bound[piece] = mobilityBonus[piece] * mostMoves +
+                   kingZoneAttack * mostKingZoneAttacks;
   }
+  return bound;
+}();
 
-  if (state.uneventfulHalfMoves >= 50) {
+/// @brief The squares b1, a2, ... (those of the same color as h1).
+const BitBoards::BitBoard lightSquares{0x55aa55aa55aa55aa};
+
+namespace {
+
+/// @return the score tapered by the phase, with the endgame value scaled by
+/// `scale` (out of `fullScale`), from white's point of view.
+int tapered(Score score, const MaterialEntry& material, int scale) {
+  int phase = material.phase;
+  return (midgame(score) * phase * fullScale +
+          endgame(score) * scale * (midgamePhase - phase)) /
+         (midgamePhase * fullScale);
+}
+
+/// @return the score tapered by the phase, with the endgame value scaled by
+/// `scale` (out of `fullScale`), from the side to move's point of view.
+int taper(const Position& position, Score score, const MaterialEntry& material,
+          int scale) {
+  int result = tapered(score, material, scale);
+  return position.us() == Color::white ? result : -result;
+}
+
+/// @brief Stage 2, besides the pawn structure: threats by pawns and free
+/// passed pawns, from white's point of view.
+Score pawnPieceScore(const Position& position, const PawnEntry& pawns) {
+  Score score = 0;
+  BitBoards::BitBoard occupancy = position.occupancy();
+  for (Color::t color : Color::all) {
+    Color::t them = Color::opponent(color);
+    Score own = 0;
+    BitBoards::BitBoard officers = position.forColor(color) &
+                                   ~position.forPiece(Piece::pawn) &
+                                   ~position.forPiece(Piece::king);
+    own += threatenedByPawn *
+           (officers & pawns.attacks[them]).populationCount();
+    BitBoards::BitBoard passed = pawns.passed[color];
+    for (Square::t square : passed) {
+      BitBoards::BitBoard path = BitBoards::wholeFile(Square::file(square)) &
+                                 forwardRanks(color, Square::rank(square));
+      if ((occupancy & path).isEmpty()) {
+        own += freePasser *
+               Square::rank(Square::reverseForColor(square, color));
+      }
+    }
+    score += color == Color::white ? own : -own;
+  }
+  return score;
+}
+
+/// @brief Stage 3: mobility and attacks on the squares around the enemy
+/// king, from white's point of view.
+Score pieceScore(const Position& position, const PawnEntry& pawns) {
+  Score score = 0;
+  BitBoards::BitBoard occupancy = position.occupancy();
+  for (Color::t color : Color::all) {
+    Color::t them = Color::opponent(color);
+    Score own = 0;
+    BitBoards::BitBoard safe = ~pawns.attacks[them];
+    BitBoards::BitBoard enemyKing = position.forPiece(Piece::king, them);
+    BitBoards::BitBoard kingZone{};
+    if (!enemyKing.isEmpty()) {
+      kingZone = MoveTables::kingMoves(enemyKing.findFirstSet());
+    }
+    for (Piece::t piece : Piece::officers) {
+      for (Square::t square : position.forPiece(piece, color)) {
+        BitBoards::BitBoard moves =
+            position.getMoves(piece, color, square, occupancy);
+        own += mobilityBonus[piece] * (moves & safe).populationCount();
+        own += kingZoneAttack * (moves & kingZone).populationCount();
+      }
+    }
+    score += color == Color::white ? own : -own;
+  }
+  return score;
+}
+
+/// @brief By color, the most `pieceScore` can add in that color's favour.
+std::array<Score, Color::size> pieceScoreBounds(const Position& position) {
+  std::array<Score, Color::size> bounds = {0, 0};
+  for (Color::t color : Color::all) {
+    for (Piece::t piece : Piece::officers) {
+      bounds[color] += officerBound[piece] *
+                       pieceCount(position.materialKey, piece, color);
+    }
+  }
+  return bounds;
+}
+
+/// @brief Whether the stages still to come, which add at most `bounds[color]`
+/// in each color's favour, cannot bring `partial` (from the side to move's
+/// point of view) back into the window `(alpha, beta)`.
+bool outsideWindow(const Position& position,
+                   const std::array<Score, Color::size>& bounds,
+                   const MaterialEntry& material, int scale, int partial,
+                   int alpha, int beta) {
+  // Two more for the rounding of `taper`, once in `partial` and once in
+  // the full evaluation.
+  int gain = tapered(bounds[position.us()], material, scale) + 2;
+  int loss = tapered(bounds[position.them()], material, scale) + 2;
+  return partial - loss >= beta || partial + gain <= alpha;
+}
+
+/// @brief The classical evaluation in three stages of increasing cost:
+/// material and piece-square values (kept up to date by the position), the
+/// pawn structure with what the pawns do to the pieces (usually found in the
+/// pawn table) and the mobility of the pieces. After the second, it stops
+/// early if the last stage cannot bring the score back into the window
+/// `(alpha, beta)`. This is judged by bounds on its terms for each side
+/// (see `pieceScoreBounds`) that hold for every position, so a lazy result
+/// is always on the same side of the window as the full one. There is no
+/// exit after the first stage: sound bounds on the pawn terms cost about as
+/// much to compute as the pawn table probe they would save.
+/// @param pawnTable the table to look the pawn structure up in, or
+/// `nullptr` to evaluate it from scratch.
+/// @param exact set to whether all stages were evaluated; if not, the
+/// result is only known to be at most `alpha` or at least `beta`.
+int classicalEval(const GameState& state, const MaterialEntry& material,
+                  PawnTable* pawnTable, int alpha, int beta, bool& exact) {
+  assert(state.psqt == pieceSquareScore(state));
+  exact = false;
+  // The side that is ahead in material is the one whose advantage is scaled.
+  // It is decided on the first stage's score only, so that all stages scale
+  // by the same factor.
+  Color::t ahead = endgame(state.psqt) >= 0 ? Color::white : Color::black;
+  int scale = material.scale[ahead];
+
+  Score score = state.psqt;
+  PawnEntry computed{};
+  if (pawnTable == nullptr) {
+    computed = evaluatePawns(state);
+  }
+  PawnEntry& pawns = pawnTable ? pawnTable->probe(state) : computed;
+  assert(pawns.score == evaluatePawns(state).score);
+  score += pawns.score + pawns.shelter(state, Color::white) -
+           pawns.shelter(state, Color::black) + pawnPieceScore(state, pawns);
+  int partial = taper(state, score, material, scale);
+  if (outsideWindow(state, pieceScoreBounds(state), material, scale, partial,
+                    alpha, beta)) {
+    return partial;
+  }
+
+  exact = true;
+  return taper(state, score + pieceScore(state, pawns), material, scale);
+}
+
+/// @brief A won KPK position is worth less than a queen, so that the search
+/// still promotes, and more the further the pawn has come.
+constexpr int kpkWin = Piece::worth[Piece::rook];
+constexpr int kpkAdvance = 20;
+
+/// @brief The exact evaluation of king and pawn against king from the
+/// bitbase, or `std::nullopt` for other material.
+std::optional<int> kingPawnKing(const Position& position) {
+  auto result = Tablebases::probeKPK(position);
+  if (!result) {
+    return std::nullopt;
+  }
+  Square::t pawn = position.forPiece(Piece::pawn).findFirstSet();
+  Coord::t rank =
+      Square::rank(Square::reverseForColor(pawn, position.getColor(pawn)));
+  return *result * (kpkWin + kpkAdvance * rank);
+}
+
+/// @brief The evaluation that does not depend on the pawn structure, or
+/// `std::nullopt` if it has to be computed.
+/// @param material set to the position's material entry.
+std::optional<int> shortcut(const GameState& state, MaterialEntry& material) {
+  material = materialEntry(state.materialKey);
+  if (state.uneventfulHalfMoves >= 50 || isDeadDraw(state, material)) {
     return 0;
   }
+  if (auto result = kingPawnKing(state)) {
+    return result;
+  }
+  if (NNUE::enabled()) {
+    NNUE::Accumulator refreshed;
+    const NNUE::Accumulator *current = state.accumulator();
+    // outside of a search, no accumulators are kept up to date
+    if (current == nullptr) {
+      NNUE::refresh(state, refreshed);
+      return NNUE::evaluate(refreshed, state.us());
+    }
+#ifndef NDEBUG
+    NNUE::refresh(state, refreshed);
+    assert(refreshed.values == current->values);
+#endif
+    return NNUE::evaluate(*current, state.us());
+  }
+  return std::nullopt;
+}
 
+constexpr int fullWindow = std::numeric_limits<int>::max();
+
+}  // namespace
+
+bool isDeadDraw(const Position& position, const MaterialEntry& material) {
+  if (material.flags & MaterialFlags::draw) {
+    return true;
+  }
+  if (material.flags & MaterialFlags::drawWithSameColoredBishops) {
+    BitBoards::BitBoard bishops = position.forPiece(Piece::bishop);
+    return (bishops & lightSquares).isEmpty() ||
+           (bishops & ~lightSquares).isEmpty();
+  }
+  return false;
+}
+
+bool isDeadDraw(const Position& position) {
+  return isDeadDraw(position, materialEntry(position.materialKey));
+}
+
+int eval(const GameState& state) {
+  return eval(state, -fullWindow, fullWindow);
+}
+
+int eval(const GameState& state, int alpha, int beta) {
+  MaterialEntry material;
+  if (auto result = shortcut(state, material)) {
+    return *result;
+  }
+  bool exact;
+  return classicalEval(state, material, nullptr, alpha, beta, exact);
+}
+
+int eval(const GameState& state, PawnTable& pawnTable) {
+  MaterialEntry material;
+  if (auto result = shortcut(state, material)) {
+    return *result;
+  }
+  bool exact;
+  return classicalEval(state, material, &pawnTable, -fullWindow, fullWindow,
+                       exact);
+}
+
+int eval(const GameState& state, PawnTable& pawnTable, EvalCache& cache,
+         int alpha, int beta) {
+  // the hash does not cover the fifty-move counter
+  if (state.uneventfulHalfMoves >= 50) {
+    return 0;
+  }
+  int result;
+  if (cache.probe(state.hash, result)) {
+    assert(result == eval(state, pawnTable));
+    return result;
+  }
+  MaterialEntry material;
+  if (auto shortcutResult = shortcut(state, material)) {
+    result = *shortcutResult;
+    cache.store(state.hash, result);
+    return result;
+  }
+  bool exact;
+  result = classicalEval(state, material, &pawnTable, alpha, beta, exact);
+  cache.countEvaluation(exact);
+  // a lazy result is only a bound and must not be taken for the evaluation
+  if (exact) {
+    cache.store(state.hash, result);
+  }
   return result;
 }
 
-}  // namespace Dagor::Eval
\ No newline at end of file
+EvalCache::EvalCache(std::size_t kiB)
+    : entries(), probeCount{0}, hitCount{0}, evaluationCount{0}, lazyCount{0} {
+  resize(kiB);
+}
+
+std::size_t EvalCache::entriesFor(std::size_t kiB) {
+  std::size_t size = kiB * 1024 / sizeof(std::uint64_t);
+  // round down to a power of two, so that the index is a mask of the hash
+  while ((size & (size - 1)) != 0) size &= size - 1;
+  return size;
+}
+
+void EvalCache::resize(std::size_t kiB) {
+  entries.assign(entriesFor(kiB), 0);
+  resetStatistics();
+}
+
+void EvalCache::clear() {
+  std::fill(entries.begin(), entries.end(), 0);
+}
+
+}  // namespace Dagor::Eval
@@ -1,11 +1,112 @@
 #ifndef EVAL_H
 #define EVAL_H
 
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
 #include "game_state.h"
+#include "pawns.h"
 
 namespace Dagor::Eval {
 
+/// @brief A direct-mapped cache of static evaluations by position hash. An
+/// entry holds the upper 48 bits of the hash and the evaluation in the lower
+/// 16 bits, so that a probe is a single load. Each search thread owns one.
+class EvalCache {
+ private:
+  std::vector<std::uint64_t> entries;
+  std::uint64_t probeCount;
+  std::uint64_t hitCount;
+  std::uint64_t evaluationCount;
+  std::uint64_t lazyCount;
+
+  static constexpr std::uint64_t valueMask = 0xffff;
+
+ public:
+  static constexpr std::size_t defaultKiB = 512;
+
+  /// @param kiB the size in KiB, rounded down to a power of two entries;
+  /// 0 disables the cache.
+  explicit EvalCache(std::size_t kiB = defaultKiB);
+
+  /// @brief Changes the size (see the constructor) and clears the cache.
+  void resize(std::size_t kiB);
+  void clear();
+  /// @return the number of entries of a cache of `kiB` KiB.
+  static std::size_t entriesFor(std::size_t kiB);
+  std::size_t size() const { return entries.size(); }
+
+  /// @return whether the evaluation of the position with hash `key` is
+  /// cached, and if so, the evaluation in `value`.
+  bool probe(std::uint64_t key, int& value) {
+    if (entries.empty()) return false;
+    probeCount++;
+    std::uint64_t entry = entries[key & (entries.size() - 1)];
+    if (((entry ^ key) & ~valueMask) != 0) return false;
+    hitCount++;
+    value = static_cast<std::int16_t>(entry & valueMask);
+    return true;
+  }
+
+  void store(std::uint64_t key, int value) {
+    if (entries.empty()) return;
+    assert(value == static_cast<std::int16_t>(value));
+    entries[key & (entries.size() - 1)] =
+        (key & ~valueMask) | static_cast<std::uint16_t>(value);
+  }
+
+  /// @brief Counts a classical evaluation done after a miss, and whether it
+  /// stopped early (and was therefore not stored).
+  void countEvaluation(bool exact) {
+    evaluationCount++;
+    lazyCount += !exact;
+  }
+
+  std::uint64_t probes() const { return probeCount; }
+  std::uint64_t hits() const { return hitCount; }
+  std::uint64_t evaluations() const { return evaluationCount; }
+  std::uint64_t lazyExits() const { return lazyCount; }
+  void resetStatistics() {
+    probeCount = 0;
+    hitCount = 0;
+    evaluationCount = 0;
+    lazyCount = 0;
+  }
+};
+
+/// @brief The static evaluation of a position in centipawns, from the point
+/// of view of the side to move. Material, piece-square values, the pawn
+/// structure, mobility and attacks on the king are tapered between their
+/// midgame and endgame values by the remaining pieces. King and pawn against
+/// king is looked up in the KPK bitbase instead: a draw is 0, a win a fixed
+/// score below a queen that grows as the pawn advances.
 int eval(const GameState& state);
+/// @brief Lazy `eval`: the evaluation is done in stages of increasing cost
+/// and stops as soon as the remaining stages cannot bring the score back into
+/// the window `(alpha, beta)`. The result is exact if it lies inside the
+/// window; otherwise it is only on the same side of the window as the exact
+/// evaluation.
+int eval(const GameState& state, int alpha, int beta);
+/// @brief `eval`, with the pawn structure looked up in (and added to) a pawn
+/// hash table.
+int eval(const GameState& state, PawnTable& pawnTable);
+/// @brief Lazy `eval` (see above), looked up in an evaluation cache first and
+/// with the pawn structure looked up in a pawn hash table. Only exact
+/// evaluations are added to the cache. The cache must be cleared when the
+/// evaluation settings change, e. g. `NNUE::enable`.
+int eval(const GameState& state, PawnTable& pawnTable, EvalCache& cache,
+         int alpha, int beta);
+
+/// @brief Whether neither side can ever mate, judged by the material (see
+/// `MaterialFlags`). The search treats such positions as draws right away.
+bool isDeadDraw(const Position& position);
+bool isDeadDraw(const Position& position, const MaterialEntry& material);
+
+/// @brief Recomputes the material and piece-square score of a position from
+/// scratch. Debug builds check the incrementally updated `Position::psqt`
+/// against it.
+Score pieceSquareScore(const Position& position);
 
 }  // namespace Dagor::Eval
 
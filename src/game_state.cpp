@@ -1,8 +1,9 @@
 #include "game_state.h"
 
+#include <cassert>
+#include <cstdlib>
 #include <sstream>
 #include <stdexcept>
-#include <unordered_map>
 #include <vector>
 
 namespace Dagor {
@@ -15,52 +16,44 @@ constexpr Square::t enPassantCapture(Square::t enPassantSquare) {
   }
 }
 
+template <Piece::t piece>
+BitBoards::BitBoard movesOf(const Position &position, Color::t color,
+                            Square::t square, BitBoards::BitBoard occupancy) {
+  if (color == Color::white) {
+    return position.getMoves<piece, Color::white>(square, occupancy);
+  } else {
+    return position.getMoves<piece, Color::black>(square, occupancy);
+  }
+}
+
 // no special moves: en passant and castling
-BitBoards::BitBoard GameState::getMoves(Piece::t piece, Color::t color,
+BitBoards::BitBoard Position::getMoves(Piece::t piece, Color::t color,
                                         Square::t square,
                                         BitBoards::BitBoard occupancy) const {
-  auto moves = BitBoards::BitBoard();
   switch (piece) {
-    case Piece::pawn: {
-      Square::t offset =
-          (color == Color::white) ? Square::north : Square::south;
-      bool canDoubleStep = (color == Color::white) ? Square::rank(square) == 1
-                                                   : Square::rank(square) == 6;
-      moves |= BitBoards::BitBoard(1UL << (square + offset)) & ~occupancy;
-      if (canDoubleStep && !moves.isEmpty()) {
-        moves |= BitBoards::BitBoard(1UL << (square + 2 * offset)) & ~occupancy;
-      }
-      moves |= MoveTables::pawnAttacks(color, square) & occupancy;
-    } break;
+    case Piece::pawn:
+      return movesOf<Piece::pawn>(*this, color, square, occupancy);
     case Piece::knight:
-      moves |= MoveTables::knightMoves(square);
-      break;
-    case Piece::king:
-      moves |= MoveTables::kingMoves(square);
-      break;
+      return movesOf<Piece::knight>(*this, color, square, occupancy);
     case Piece::bishop:
-      moves |= MoveTables::bishopHashes[square].lookUp(occupancy);
-      break;
+      return movesOf<Piece::bishop>(*this, color, square, occupancy);
     case Piece::rook:
-      moves |= MoveTables::rookHashes[square].lookUp(occupancy);
-      break;
+      return movesOf<Piece::rook>(*this, color, square, occupancy);
     case Piece::queen:
-      moves |= MoveTables::bishopHashes[square].lookUp(occupancy);
-      moves |= MoveTables::rookHashes[square].lookUp(occupancy);
-      break;
-
+      return movesOf<Piece::queen>(*this, color, square, occupancy);
+    case Piece::king:
+      return movesOf<Piece::king>(*this, color, square, occupancy);
     default:
       return {};
   }
-  return moves & ~forColor(color);
 }
 
-BitBoards::BitBoard GameState::getMoves(Piece::t piece, Color::t color,
+BitBoards::BitBoard Position::getMoves(Piece::t piece, Color::t color,
                                         Square::t square) const {
   return getMoves(piece, color, square, occupancy());
 }
 
-BitBoards::BitBoard GameState::getAttacks(Square::t square, Color::t color,
+BitBoards::BitBoard Position::getAttacks(Square::t square, Color::t color,
                                           BitBoards::BitBoard occupancy) const {
   auto attackers = BitBoards::BitBoard();
   for (auto piece : Piece::all) {
@@ -70,50 +63,197 @@ BitBoards::BitBoard GameState::getAttacks(Square::t square, Color::t color,
   return attackers;
 }
 
-BitBoards::BitBoard GameState::getAttacks(Square::t square,
+BitBoards::BitBoard Position::getAttacks(Square::t square,
                                           Color::t color) const {
   return getAttacks(square, color, occupancy());
 }
 
-bool GameState::isCheck() {
-  Square::t kingSquare = forPiece(Piece::king, us()).findFirstSet();
-  auto attacks = getAttacks(kingSquare, us());
-  return !attacks.isEmpty();
+BitBoards::BitBoard Position::attackMap(Color::t color,
+                                        BitBoards::BitBoard occupancy) const {
+  auto attacks = BitBoards::pawnAttacks(forPiece(Piece::pawn, color), color);
+  for (Square::t square : forPiece(Piece::knight, color)) {
+    attacks |= MoveTables::knightMoves(square);
+  }
+  auto queens = forPiece(Piece::queen, color);
+  for (Square::t square : forPiece(Piece::bishop, color) | queens) {
+    attacks |= MoveTables::bishopMoves(square, occupancy);
+  }
+  for (Square::t square : forPiece(Piece::rook, color) | queens) {
+    attacks |= MoveTables::rookMoves(square, occupancy);
+  }
+  for (Square::t square : forPiece(Piece::king, color)) {
+    attacks |= MoveTables::kingMoves(square);
+  }
+  return attacks;
+}
+
+BitBoards::BitBoard Position::attackMap(Color::t color) const {
+  auto attacks = BitBoards::pawnAttacks(forPiece(Piece::pawn, color), color);
+  for (Square::t square : forPiece(Piece::knight, color)) {
+    attacks |= MoveTables::knightMoves(square);
+  }
+  auto queens = forPiece(Piece::queen, color);
+  attacks |= BitBoards::slidingAttacks(forPiece(Piece::rook, color) | queens,
+                                       forPiece(Piece::bishop, color) | queens,
+                                       ~occupancy());
+  for (Square::t square : forPiece(Piece::king, color)) {
+    attacks |= MoveTables::kingMoves(square);
+  }
+  return attacks;
+}
+
+/// @brief Finds the pieces (of both colors) that are the only piece between
+/// the king of `color` and an enemy slider.
+/// @param position
+/// @param color
+/// @param checkers the enemy sliders that give check are added to this.
+/// @return the blockers.
+BitBoards::BitBoard sliderBlockers(const Position &position, Color::t color,
+                                   BitBoards::BitBoard &checkers) {
+  BitBoards::BitBoard blockers{};
+  auto king = position.forPiece(Piece::king, color);
+  if (king.isEmpty()) {
+    return blockers;
+  }
+  Square::t kingSquare = king.findFirstSet();
+  Color::t enemy = Color::opponent(color);
+  auto queens = position.forPiece(Piece::queen, enemy);
+  auto snipers = (MoveTables::rookMoves(kingSquare, {}) &
+                  (position.forPiece(Piece::rook, enemy) | queens)) |
+                 (MoveTables::bishopMoves(kingSquare, {}) &
+                  (position.forPiece(Piece::bishop, enemy) | queens));
+  auto occupancy = position.occupancy();
+  for (Square::t sniper : snipers) {
+    auto between = MoveTables::between(kingSquare, sniper) & occupancy;
+    if (between.isEmpty()) {
+      checkers.setSquare(sniper);
+    } else if (between.populationCount() == 1) {
+      blockers |= between;
+    }
+  }
+  return blockers;
+}
+
+void Position::updateCheckInfo() {
+  BitBoards::BitBoard discoveredCheckers{};
+  checkers = {};
+  blockersForKing[us()] = sliderBlockers(*this, us(), checkers);
+  blockersForKing[them()] = sliderBlockers(*this, them(), discoveredCheckers);
+
+  auto ourKing = forPiece(Piece::king, us());
+  if (!ourKing.isEmpty()) {
+    Square::t kingSquare = ourKing.findFirstSet();
+    checkers |=
+        ((MoveTables::pawnAttacks(us(), kingSquare) & forPiece(Piece::pawn)) |
+         (MoveTables::knightMoves(kingSquare) & forPiece(Piece::knight))) &
+        forColor(them());
+  }
+
+  auto theirKing = forPiece(Piece::king, them());
+  if (theirKing.isEmpty()) {
+    checkSquares.fill({});
+    return;
+  }
+  Square::t kingSquare = theirKing.findFirstSet();
+  auto occupied = occupancy();
+  checkSquares[Piece::pawn] = MoveTables::pawnAttacks(them(), kingSquare);
+  checkSquares[Piece::knight] = MoveTables::knightMoves(kingSquare);
+  checkSquares[Piece::bishop] = MoveTables::bishopMoves(kingSquare, occupied);
+  checkSquares[Piece::rook] = MoveTables::rookMoves(kingSquare, occupied);
+  checkSquares[Piece::queen] =
+      checkSquares[Piece::bishop] | checkSquares[Piece::rook];
+  checkSquares[Piece::king] = {};
+}
+
+bool Position::givesCheck(Move move) const {
+  if (move.kind() != MoveKind::normal) {
+    // These moves are rare and change the board in several places at once.
+    return apply(move).isCheck();
+  }
+  Piece::t piece = getPiece(move.start());
+  if (checkSquares[piece].isSet(move.end())) {
+    return true;
+  }
+  // discovered check
+  Square::t theirKing = forPiece(Piece::king, them()).findFirstSet();
+  return blockersForKing[them()].isSet(move.start()) &&
+         !MoveTables::line(move.start(), theirKing).isSet(move.end());
 }
 
+/// @brief Generates the moves of one mode for one side. If not `legal`, the
+/// moves are only pseudo-legal: pins, the safety of the king's target squares
+/// and the squares a castling king passes are left to `Position::isLegal`.
+template <GenerationMode::t mode, Color::t myColor, bool legal>
 struct MoveGenerator {
+  static constexpr bool withPromotions =
+      mode != GenerationMode::quiets && mode != GenerationMode::quietChecks;
+  static constexpr bool withCastling =
+      mode == GenerationMode::all || mode == GenerationMode::quiets ||
+      mode == GenerationMode::quietChecks;
+
+  static constexpr Color::t opponentColor = Color::opponent(myColor);
+  static constexpr bool white = myColor == Color::white;
+  static constexpr int up = white ? Square::north : Square::south;
+  static constexpr BitBoards::BitBoard thirdRank{white ? 0xff0000ULL
+                                                       : 0xff0000000000ULL};
+  static constexpr BitBoards::BitBoard lastRank{white ? 0xff00000000000000ULL
+                                                      : 0xffULL};
+  static constexpr BitBoards::BitBoard notAFile{0xfefefefefefefefeULL};
+  static constexpr BitBoards::BitBoard notHFile{0x7f7f7f7f7f7f7f7fULL};
+
   std::uint8_t attacksOnKing;
-  const Color::t myColor;
-  const Color::t opponentColor;
   const Square::t kingSquare;
 
-  const GameState &state;
+  const Position &state;
   BitBoards::BitBoard targets;
+  /// @brief The squares non-promoting moves may go to in this mode: the
+  /// enemy pieces for captures, the empty squares for quiet moves.
+  BitBoards::BitBoard modeTargets;
   BitBoards::BitBoard pins;
-  std::unordered_map<Square::t, BitBoards::BitBoard> pinRays;
+  /// @brief The squares attacked by the opponent, seen through our king, so
+  /// that the king cannot step back along the ray of a checking slider.
+  BitBoards::BitBoard attacked;
 
-  std::vector<Move> moves;
+  MoveList &moves;
 
-  MoveGenerator(const GameState &state)
-      : attacksOnKing{0},
-        myColor{state.next},
-        opponentColor{Color::opponent(state.next)},
+  MoveGenerator(const Position &state, MoveList &moves)
+      : attacksOnKing{static_cast<std::uint8_t>(
+            state.checkers.populationCount())},
         kingSquare{state.forPiece(Piece::king, myColor).findFirstSet()},
         state{state},
         targets{BitBoards::all},
-        pins{0},
-        pinRays{},
-        moves{} {
-    handleLeaperAttacks(Piece::pawn);
-    handleLeaperAttacks(Piece::knight);
-    handleSliderAttacks();
+        modeTargets{BitBoards::all},
+        pins{},
+        attacked{},
+        moves{moves} {
+    if constexpr (legal) {
+      pins = state.blockersForKing[myColor] & state.forColor(myColor);
+      attacked = state.attackMap(
+          opponentColor, state.occupancy() & ~BitBoards::single(kingSquare));
+    }
+    if constexpr (mode == GenerationMode::captures) {
+      modeTargets = state.forColor(opponentColor);
+    } else if constexpr (mode == GenerationMode::quiets ||
+                         mode == GenerationMode::quietChecks) {
+      modeTargets = ~state.occupancy();
+    }
+    if (attacksOnKing == 1) {
+      // capture the checking piece or block its way
+      targets = MoveTables::between(kingSquare,
+                                    state.checkers.findFirstSet()) |
+                state.checkers;
+    }
 
     if (attacksOnKing <= 1) {
-      standardNonPins();
-      if (attacksOnKing == 0) {
+      generatePawnMoves();
+      generatePieceMoves<Piece::knight>();
+      generatePieceMoves<Piece::bishop>();
+      generatePieceMoves<Piece::rook>();
+      generatePieceMoves<Piece::queen>();
+      if (withCastling && attacksOnKing == 0) {
         generateCastling();
       }
-      if (Square::inRange(state.enPassantSquare)) {
+      if (withPromotions && Square::inRange(state.enPassantSquare)) {
         enPassantCaptures();
       }
     }
@@ -122,344 +262,463 @@ struct MoveGenerator {
   }
 
  private:
+  /// @brief Adds a move, unless it is filtered out by the mode.
+  void add(Move move) {
+    if constexpr (mode == GenerationMode::quietChecks) {
+      if (!state.givesCheck(move)) return;
+    }
+    moves.push_back(move);
+  }
+
   void enPassantCaptures() {
     auto electablePawns =
-        state.getMoves(Piece::pawn, opponentColor, state.enPassantSquare) &
+        state.getMoves<Piece::pawn, opponentColor>(state.enPassantSquare,
+                                                   state.occupancy()) &
         state.forPiece(Piece::pawn, myColor);
 
-    Square::t capturePawn = enPassantCapture(state.enPassantSquare);
+    Square::t capturePawn = state.enPassantSquare - up;
     if (targets.isSet(capturePawn)) {
       // The opponents pawn is already there, so we never need to
       // intercept a check by moving there. Therefore, if we have set
       // the pawn as a target, it's because we want to capture him.
       targets.setSquare(state.enPassantSquare);
     }
-    if (Square::rank(kingSquare) == Square::rank(capturePawn) &&
+    if (legal && Square::rank(kingSquare) == Square::rank(capturePawn) &&
         electablePawns.populationCount() == 1) {
       // In this case we need to reevaluate the pins, because we
       // can remove two pieces from a rank at once
       Square::t attackerSquare = electablePawns.findFirstSet();
       BitBoards::BitBoard occupancy{state.occupancy()};
       occupancy.unsetSquare(capturePawn);
-      auto rays = state.getMoves(Piece::rook, myColor, kingSquare, occupancy);
-      auto ray =
-          rays & (kingSquare < attackerSquare ? BitBoards::rightOf(kingSquare)
-                                              : BitBoards::leftOf(kingSquare));
-      enterMoves(attackerSquare, Piece::pawn,
-                 BitBoards::single(state.enPassantSquare) & ray);
+      occupancy.unsetSquare(attackerSquare);
+      auto sliders = (state.forPiece(Piece::rook) |
+                      state.forPiece(Piece::queen)) &
+                     state.forColor(opponentColor);
+      if ((MoveTables::rookMoves(kingSquare, occupancy) & sliders).isEmpty()) {
+        enterEnPassant(attackerSquare,
+                       BitBoards::single(state.enPassantSquare));
+      }
     } else {
       for (Square::t start : electablePawns) {
         if (pins.isSet(start)) {
-          enterMoves(start, Piece::pawn,
-                     BitBoards::single(state.enPassantSquare) & pinRays[start]);
+          enterEnPassant(start, BitBoards::single(state.enPassantSquare) &
+                                    MoveTables::line(kingSquare, start));
         } else {
-          enterMoves(start, Piece::pawn,
-                     BitBoards::single(state.enPassantSquare));
+          enterEnPassant(start, BitBoards::single(state.enPassantSquare));
         }
       }
     }
   }
 
   void generateCastling() {
-    BitBoards::BitBoard wqEmpty{0xe};
-    BitBoards::BitBoard wkEmpty{0x60};
-    BitBoards::BitBoard bqEmpty{0xe00000000000000};
-    BitBoards::BitBoard bkEmpty{0x6000000000000000};
+    // the squares between king and rook, and those the king passes over and
+    // ends on
+    constexpr BitBoards::BitBoard queenSideEmpty{white ? 0xeULL
+                                                       : 0xe00000000000000ULL};
+    constexpr BitBoards::BitBoard kingSideEmpty{white ? 0x60ULL
+                                                      : 0x6000000000000000ULL};
+    constexpr BitBoards::BitBoard queenSideSafe{white ? 0xcULL
+                                                      : 0xc00000000000000ULL};
+    constexpr BitBoards::BitBoard kingSideSafe{white ? 0x60ULL
+                                                     : 0x6000000000000000ULL};
+    constexpr auto queenSideRight = white ? CastlingRights::whiteQueenSide
+                                          : CastlingRights::blackQueenSide;
+    constexpr auto kingSideRight = white ? CastlingRights::whiteKingSide
+                                         : CastlingRights::blackKingSide;
     BitBoards::BitBoard occupancy{state.occupancy()};
-    if (myColor == Color::white) {
-      bool right = state.castlingRights & CastlingRights::whiteQueenSide;
-      right = right && (occupancy & wqEmpty).isEmpty();
-      right = right && state.getAttacks(Square::d1, myColor).isEmpty();
-      right = right && state.getAttacks(Square::c1, myColor).isEmpty();
-      if (right) {
-        moves.push_back(wqCastle);
-      }
 
-      right = state.castlingRights & CastlingRights::whiteKingSide;
-      right = right && (occupancy & wkEmpty).isEmpty();
-      right = right && state.getAttacks(Square::f1, myColor).isEmpty();
-      right = right && state.getAttacks(Square::g1, myColor).isEmpty();
-      if (right) {
-        moves.push_back(wkCastle);
-      }
-    } else {
-      bool right = state.castlingRights & CastlingRights::blackQueenSide;
-      right = right && (occupancy & bqEmpty).isEmpty();
-      right = right && state.getAttacks(Square::d8, myColor).isEmpty();
-      right = right && state.getAttacks(Square::c8, myColor).isEmpty();
-      if (right) {
-        moves.push_back(bqCastle);
-      }
+    bool right = state.castlingRights & queenSideRight;
+    right = right && (occupancy & queenSideEmpty).isEmpty();
+    right = right && (attacked & queenSideSafe).isEmpty();
+    if (right) {
+      add(white ? wqCastle : bqCastle);
+    }
 
-      right = state.castlingRights & CastlingRights::blackKingSide;
-      right = right && (occupancy & bkEmpty).isEmpty();
-      right = right && state.getAttacks(Square::f8, myColor).isEmpty();
-      right = right && state.getAttacks(Square::g8, myColor).isEmpty();
-      if (right) {
-        moves.push_back(bkCastle);
-      }
+    right = state.castlingRights & kingSideRight;
+    right = right && (occupancy & kingSideEmpty).isEmpty();
+    right = right && (attacked & kingSideSafe).isEmpty();
+    if (right) {
+      add(white ? wkCastle : bkCastle);
     }
   }
 
-  void standardNonPins() {
-    for (auto piece : Piece::nonKing) {
-      auto positions = state.forPiece(piece, myColor);
-      auto notPinned = positions & ~pins;
-      for (auto start : notPinned) {
-        enterMoves(start, piece, state.getMoves(piece, myColor, start));
+  template <Piece::t piece>
+  void generatePieceMoves() {
+    auto positions = state.forPiece(piece, myColor);
+    auto occupancy = state.occupancy();
+    for (auto start : positions & ~pins) {
+      enterMoves(start, state.getMoves<piece, myColor>(start, occupancy));
+    }
+    for (auto start : positions & pins) {
+      // a pinned piece can only move along the line to the king
+      auto ray = MoveTables::line(kingSquare, start);
+      enterMoves(start, state.getMoves<piece, myColor>(start, occupancy) & ray);
+    }
+  }
+
+  /// @brief Generates all pawn moves but en passant, with the pushes and
+  /// captures of all unpinned pawns computed set-wise.
+  void generatePawnMoves() {
+    auto pawns = state.forPiece(Piece::pawn, myColor);
+    auto occupancy = state.occupancy();
+    for (auto start : pawns & pins) {
+      auto ray = MoveTables::line(kingSquare, start);
+      auto ends = state.getMoves<Piece::pawn, myColor>(start, occupancy);
+      ends = pawnEnds(ends & ray);
+      for (auto end : ends & lastRank) {
+        enterPromotions(start, end);
       }
-      auto pinned = positions & pins;
-      for (auto start : pinned) {
-        auto ray = pinRays[start];
-        if (!(ray & BitBoards::single(start)).isEmpty()) {
-          enterMoves(start, piece, state.getMoves(piece, myColor, start) & ray);
-        }
+      for (auto end : ends & ~lastRank) {
+        add(Move{start, end});
       }
     }
+
+    auto free = pawns & ~pins;
+    auto empty = ~occupancy;
+    auto enemies = state.forColor(opponentColor);
+
+    auto pushes = BitBoards::shift(free, up) & empty;
+    auto doublePushes = BitBoards::shift(pushes & thirdRank, up) & empty;
+    auto leftCaptures = BitBoards::shift(free & notAFile, up - 1) & enemies;
+    auto rightCaptures = BitBoards::shift(free & notHFile, up + 1) & enemies;
+
+    enterPawnMoves(pawnEnds(pushes), up);
+    enterPawnMoves(pawnEnds(doublePushes), 2 * up);
+    enterPawnMoves(pawnEnds(leftCaptures), up - 1);
+    enterPawnMoves(pawnEnds(rightCaptures), up + 1);
   }
 
-  void generatePlainKingMoves() {
-    BitBoards::BitBoard withoutKing{state.occupancy()};
-    withoutKing.unsetSquare(kingSquare);
-    for (auto end : state.getMoves(Piece::king, myColor, kingSquare)) {
-      if (state.getAttacks(end, myColor, withoutKing).isEmpty()) {
-        moves.push_back(Move{kingSquare, end});
-      }
+  /// @brief Restricts the ends of pawn moves to the targets and the mode.
+  BitBoards::BitBoard pawnEnds(BitBoards::BitBoard ends) const {
+    auto allowed = modeTargets & ~lastRank;
+    if constexpr (withPromotions) {
+      allowed |= lastRank;
     }
+    return ends & allowed & targets;
   }
 
-  void handleSliderAttacks() {
-    BitBoards::BitBoard bishopQueen =
-        state.forPiece(Piece::bishop, opponentColor) |
-        state.forPiece(Piece::queen, opponentColor);
-    BitBoards::BitBoard rookQueen = state.forPiece(Piece::rook, opponentColor) |
-                                    state.forPiece(Piece::queen, opponentColor);
-
-    auto rookAttacks = MoveTables::rookHashes[kingSquare].lookUp(
-        state.forColor(opponentColor));
-
-    auto upper = rookAttacks & BitBoards::above(Square::rank(kingSquare));
-    auto left = rookAttacks & BitBoards::leftOf(Square::file(kingSquare));
-    auto lower = rookAttacks & BitBoards::below(Square::rank(kingSquare));
-    auto right = rookAttacks & BitBoards::rightOf(Square::file(kingSquare));
-    handleSliderRay(rookQueen, upper);
-    handleSliderRay(rookQueen, left);
-    handleSliderRay(rookQueen, lower);
-    handleSliderRay(rookQueen, right);
-
-    auto bishopAttacks = MoveTables::bishopHashes[kingSquare].lookUp(
-        state.forColor(opponentColor));
-
-    auto upperLeft = bishopAttacks &
-                     BitBoards::above(Square::rank(kingSquare)) &
-                     BitBoards::leftOf(Square::file(kingSquare));
-    auto upperRight = bishopAttacks &
-                      BitBoards::above(Square::rank(kingSquare)) &
-                      BitBoards::rightOf(Square::file(kingSquare));
-    auto lowerLeft = bishopAttacks &
-                     BitBoards::below(Square::rank(kingSquare)) &
-                     BitBoards::leftOf(Square::file(kingSquare));
-    auto lowerRight = bishopAttacks &
-                      BitBoards::below(Square::rank(kingSquare)) &
-                      BitBoards::rightOf(Square::file(kingSquare));
-    handleSliderRay(bishopQueen, upperLeft);
-    handleSliderRay(bishopQueen, upperRight);
-    handleSliderRay(bishopQueen, lowerLeft);
-    handleSliderRay(bishopQueen, lowerRight);
-  }
-
-  void handleSliderRay(BitBoards::BitBoard opponentSliders,
-                       BitBoards::BitBoard ray) {
-    auto attackers = opponentSliders & ray;
-    if (attackers.isEmpty()) {
-      return;
+  /// @brief Enters the pawn moves to `ends` that all came from `offset`
+  /// squares before, with all four promotions on the last rank.
+  void enterPawnMoves(BitBoards::BitBoard ends, int offset) {
+    for (auto end : ends & ~lastRank) {
+      add(Move{static_cast<Square::t>(end - offset), end});
+    }
+    for (auto end : ends & lastRank) {
+      enterPromotions(end - offset, end);
     }
+  }
 
-    auto ourBlockers = ray & state.forColor(myColor);
-    if (!attackers.isEmpty()) {
-      if (ourBlockers.isEmpty()) {
-        attacksOnKing += attackers.populationCount();
-        targets &= ray;
-      } else if (ourBlockers.populationCount() == 1 && attacksOnKing <= 1) {
-        pins |= ourBlockers;
-        Square::t pinSquare = ourBlockers.findFirstSet();
-        pinRays[pinSquare] = ray;
-      }
+  void enterPromotions(Square::t start, Square::t end) {
+    add(Move{start, end, Piece::knight});
+    add(Move{start, end, Piece::bishop});
+    add(Move{start, end, Piece::rook});
+    add(Move{start, end, Piece::queen});
+  }
+
+  void generatePlainKingMoves() {
+    auto ends = state.getMoves<Piece::king, myColor>(kingSquare, {}) &
+                ~attacked & modeTargets;
+    for (auto end : ends) {
+      add(Move{kingSquare, end});
     }
   }
 
-  void handleLeaperAttacks(Piece::t piece) {
-    auto attacks = state.getMoves(piece, myColor, kingSquare) &
-                   state.forPiece(piece, opponentColor);
-    if (!attacks.isEmpty()) {
-      attacksOnKing += attacks.populationCount();
-      targets &= attacks;
+  /// @brief Enters the moves of a piece other than a pawn.
+  void enterMoves(Square::t start, BitBoards::BitBoard ends) {
+    for (auto end : ends & modeTargets & targets) {
+      add(Move{start, end});
     }
   }
 
-  void enterMoves(Square::t start, Piece::t piece, BitBoards::BitBoard ends) {
-    for (auto end : (ends & targets)) {
-      if (piece == Piece::pawn &&
-          ((myColor == Color::white && Square::rank(end) == 7) ||
-           (myColor == Color::black && Square::rank(end) == 0))) {
-        moves.push_back(Move{start, end, Piece::knight});
-        moves.push_back(Move{start, end, Piece::bishop});
-        moves.push_back(Move{start, end, Piece::rook});
-        moves.push_back(Move{start, end, Piece::queen});
-      } else {
-        moves.push_back(Move{start, end});
-      }
+  /// @brief Enters the en passant capture, whose target square is empty and
+  /// thus not among the targets of the captures mode.
+  void enterEnPassant(Square::t start, BitBoards::BitBoard ends) {
+    for (auto end : ends & targets) {
+      add(Move::enPassant(start, end));
     }
   }
 };
 
-std::vector<Move> GameState::generateLegalMoves() const {
-  return MoveGenerator{*this}.moves;
+template <GenerationMode::t mode>
+void Position::generateMoves(MoveList &moves) const {
+  assert(mode != GenerationMode::evasions || isCheck());
+  moves.clear();
+  if (next == Color::white) {
+    MoveGenerator<mode, Color::white, true>{*this, moves};
+  } else {
+    MoveGenerator<mode, Color::black, true>{*this, moves};
+  }
 }
 
-inline UndoInfo::UndoInfo(const GameState &state, const Move &move)
-    : piece{state.getPiece(move.start)},
-      capture{state.getPiece(move.end)},
-      start{move.start},
-      end{move.end},
-      enPassant{state.enPassantSquare},
-      castlingRights{state.castlingRights},
-      uneventfulHalfMoves{state.uneventfulHalfMoves},
-      flags{0} {
-  if (enPassant == end && piece == Piece::pawn) {
-    flags = MoveFlags::enPassant;
-    capture = Piece::pawn;
-  } else if (move == wkCastle && piece == Piece::king) {
-    flags = MoveFlags::whiteKingSide;
-  } else if (move == wqCastle && piece == Piece::king) {
-    flags = MoveFlags::whiteQueenSide;
-  } else if (move == bkCastle && piece == Piece::king) {
-    flags = MoveFlags::blackKingSide;
-  } else if (move == bqCastle && piece == Piece::king) {
-    flags = MoveFlags::blackQueenSide;
-  } else if (move.promotion != Piece::empty) {
-    flags = MoveFlags::promotion;
+template <GenerationMode::t mode>
+void Position::generatePseudoLegalMoves(MoveList &moves) const {
+  assert(mode != GenerationMode::evasions || isCheck());
+  moves.clear();
+  if (next == Color::white) {
+    MoveGenerator<mode, Color::white, false>{*this, moves};
+  } else {
+    MoveGenerator<mode, Color::black, false>{*this, moves};
   }
 }
 
-void GameState::executeMove(Move move) {
-  UndoInfo info{*(this), move};
-  undoStack.push(info);
+bool Position::isLegal(Move move) const {
+  Square::t king = forPiece(Piece::king, us()).findFirstSet();
+  if (move.kind() == MoveKind::castling) {
+    // the king may not pass an attacked square (it does not start on one,
+    // castling is not generated in check)
+    Square::t passed = (move.start() + move.end()) / 2;
+    return getAttacks(passed, us()).isEmpty() &&
+           getAttacks(move.end(), us()).isEmpty();
+  }
+  if (move.start() == king) {
+    auto withoutKing = occupancy() & ~BitBoards::single(king);
+    return getAttacks(move.end(), us(), withoutKing).isEmpty();
+  }
+  if (move.kind() == MoveKind::enPassant) {
+    // two pawns leave the rank of the captured one: check the board after
+    Square::t captured = enPassantCapture(enPassantSquare);
+    auto after = (occupancy() & ~BitBoards::single(move.start()) &
+                  ~BitBoards::single(captured)) |
+                 BitBoards::single(move.end());
+    auto queens = forPiece(Piece::queen, them());
+    return (MoveTables::rookMoves(king, after) &
+            (forPiece(Piece::rook, them()) | queens))
+               .isEmpty() &&
+           (MoveTables::bishopMoves(king, after) &
+            (forPiece(Piece::bishop, them()) | queens))
+               .isEmpty();
+  }
+  return !blockersForKing[us()].isSet(move.start()) ||
+         MoveTables::line(king, move.start()).isSet(move.end());
+}
 
-  if (info.piece != Piece::pawn && info.capture == Piece::empty) {
-    uneventfulHalfMoves++;
-  } else {
-    uneventfulHalfMoves = 0;
-  }
+template void Position::generateMoves<GenerationMode::all>(MoveList &) const;
+template void Position::generateMoves<GenerationMode::captures>(
+    MoveList &) const;
+template void Position::generateMoves<GenerationMode::quiets>(
+    MoveList &) const;
+template void Position::generateMoves<GenerationMode::evasions>(
+    MoveList &) const;
+template void Position::generateMoves<GenerationMode::quietChecks>(
+    MoveList &) const;
+template void Position::generatePseudoLegalMoves<GenerationMode::all>(
+    MoveList &) const;
+template void Position::generatePseudoLegalMoves<GenerationMode::captures>(
+    MoveList &) const;
+template void Position::generatePseudoLegalMoves<GenerationMode::quiets>(
+    MoveList &) const;
+template void Position::generatePseudoLegalMoves<GenerationMode::evasions>(
+    MoveList &) const;
+template void Position::generatePseudoLegalMoves<
+    GenerationMode::quietChecks>(MoveList &) const;
+
+void Position::generateLegalMoves(MoveList &moves) const {
+  generateMoves<GenerationMode::all>(moves);
+}
+
+std::vector<Move> Position::generateLegalMoves() const {
+  MoveList moves;
+  generateLegalMoves(moves);
+  return {moves.begin(), moves.end()};
+}
 
-  if (info.start == Square::e1 || info.start == Square::h1 ||
-      info.end == Square::h1) {
-    castlingRights &= ~CastlingRights::whiteKingSide;
+Move Position::parseMove(const std::string &algebraic) const {
+  Move plain{algebraic};
+  MoveList moves;
+  generateLegalMoves(moves);
+  for (Move move : moves) {
+    if (move.start() == plain.start() && move.end() == plain.end() &&
+        move.promotion() == plain.promotion()) {
+      return move;
+    }
   }
-  if (info.start == Square::e1 || info.start == Square::a1 ||
-      info.end == Square::a1) {
-    castlingRights &= ~CastlingRights::whiteQueenSide;
+  throw std::invalid_argument{"illegal move: `" + algebraic + '`'};
+}
+
+/// @brief The start and end square of the rook in a castling move.
+struct CastlingRook {
+  Square::t start;
+  Square::t end;
+};
+
+/// @brief The rook's squares for castling, by the square the king ends on.
+/// The rook jumps over the king. Only the four castling squares are used.
+constexpr std::array<CastlingRook, Square::size> castlingRooks = [] {
+  std::array<CastlingRook, Square::size> rooks{};
+  rooks[Square::g1] = {Square::h1, Square::f1};
+  rooks[Square::c1] = {Square::a1, Square::d1};
+  rooks[Square::g8] = {Square::h8, Square::f8};
+  rooks[Square::c8] = {Square::a8, Square::d8};
+  return rooks;
+}();
+
+/// @brief The castling rights that survive a move from or to a square. A
+/// king or rook leaving its home square, or a rook being captured there,
+/// loses the rights that depend on it.
+constexpr std::array<CastlingRights::t, Square::size> castlingRightsKept = [] {
+  std::array<CastlingRights::t, Square::size> kept{};
+  for (auto &rights : kept) rights = CastlingRights::fullRights;
+  auto lose = [&kept](Square::t square, CastlingRights::t rights) {
+    kept[square] &= static_cast<CastlingRights::t>(~rights);
+  };
+  lose(Square::e1,
+       CastlingRights::whiteKingSide | CastlingRights::whiteQueenSide);
+  lose(Square::h1, CastlingRights::whiteKingSide);
+  lose(Square::a1, CastlingRights::whiteQueenSide);
+  lose(Square::e8,
+       CastlingRights::blackKingSide | CastlingRights::blackQueenSide);
+  lose(Square::h8, CastlingRights::blackKingSide);
+  lose(Square::a8, CastlingRights::blackQueenSide);
+  return kept;
+}();
+
+void GameState::executeMove(Move move) {
+  if (undoCount == undoCapacity) {
+    throw std::length_error{"more than " + std::to_string(undoCapacity) +
+                            " moves to undo"};
   }
-  if (info.start == Square::e8 || info.start == Square::h8 ||
-      info.end == Square::h8) {
-    castlingRights &= ~CastlingRights::blackKingSide;
+  checkInfoStack[undoCount] = {checkers, blockersForKing, checkSquares};
+  undoStack[undoCount++] = {hash, getPiece(move.end()), castlingRights,
+                            enPassantSquare, uneventfulHalfMoves};
+  if (accumulators != nullptr) {
+    updateAccumulator(move);
   }
-  if (info.start == Square::e8 || info.start == Square::a8 ||
-      info.end == Square::a8) {
-    castlingRights &= ~CastlingRights::blackQueenSide;
+  makeMove(move);
+}
+
+void GameState::updateAccumulator(Move move) {
+  NNUE::FeatureChanges changes;
+  Piece::t piece = getPiece(move.start());
+  Piece::t capture = getPiece(move.end());
+  changes.remove(piece, us(), move.start());
+  if (capture != Piece::empty) {
+    changes.remove(capture, them(), move.end());
+  }
+  switch (move.kind()) {
+    case MoveKind::normal:
+      changes.add(piece, us(), move.end());
+      break;
+    case MoveKind::castling: {
+      auto rook = castlingRooks[move.end()];
+      changes.add(piece, us(), move.end());
+      changes.remove(Piece::rook, us(), rook.start);
+      changes.add(Piece::rook, us(), rook.end);
+      break;
+    }
+    case MoveKind::enPassant:
+      changes.add(piece, us(), move.end());
+      changes.remove(Piece::pawn, them(), enPassantCapture(enPassantSquare));
+      break;
+    case MoveKind::promotion:
+      changes.add(move.promotion(), us(), move.end());
+      break;
   }
+  std::size_t current = undoCount - accumulatorBase;
+  NNUE::update(accumulators[current - 1], accumulators[current], changes);
+}
 
-  if (info.piece == Piece::pawn && Square::rank(info.start) == 1 &&
-      Square::rank(info.end) == 3 &&
-      !getMoves(Piece::pawn, us(), info.start + Square::north).isEmpty()) {
-    enPassantSquare = info.start + Square::north;
-  } else if (info.piece == Piece::pawn && Square::rank(info.start) == 6 &&
-             Square::rank(info.end) == 4 &&
-             !getMoves(Piece::pawn, us(), info.start + Square::south)
-                  .isEmpty()) {
-    enPassantSquare = info.start + Square::south;
+void Position::makeMove(Move move) {
+  Piece::t piece = getPiece(move.start());
+  Piece::t capture = getPiece(move.end());
+
+  if (piece != Piece::pawn && capture == Piece::empty) {
+    uneventfulHalfMoves++;
   } else {
-    enPassantSquare = Square::noSquare;
+    uneventfulHalfMoves = 0;
   }
 
-  if (info.capture != Piece::empty) {
-    unset(info.end);
+  hash ^= Zobrist::castling(castlingRights);
+  castlingRights &=
+      castlingRightsKept[move.start()] & castlingRightsKept[move.end()];
+  hash ^= Zobrist::castling(castlingRights);
+
+  Square::t previousEnPassant = enPassantSquare;
+  if (Square::inRange(enPassantSquare)) {
+    hash ^= Zobrist::enPassant(enPassantSquare);
+    enPassantSquare = Square::noSquare;
+  }
+  if (piece == Piece::pawn &&
+      std::abs(move.end() - move.start()) == 2 * Square::north) {
+    // Only recorded if an enemy pawn stands ready to capture, so that the
+    // hash does not depend on an en passant square nobody can use.
+    Square::t passed = (move.start() + move.end()) / 2;
+    if (!(MoveTables::pawnAttacks(us(), passed) &
+          forPiece(Piece::pawn, them()))
+             .isEmpty()) {
+      enPassantSquare = passed;
+      hash ^= Zobrist::enPassant(enPassantSquare);
+    }
   }
 
-  if (info.flags == MoveFlags::enPassant) {
-    Square::t captured = enPassantCapture(info.enPassant);
-    unset(captured);
-  } else if (info.flags == MoveFlags::whiteQueenSide) {
-    unset(Square::a1);
-    set(Square::d1, Piece::rook, us());
-  } else if (info.flags == MoveFlags::whiteKingSide) {
-    unset(Square::h1);
-    set(Square::f1, Piece::rook, us());
-  } else if (info.flags == MoveFlags::blackQueenSide) {
-    unset(Square::a8);
-    set(Square::d8, Piece::rook, us());
-  } else if (info.flags == MoveFlags::blackKingSide) {
-    unset(Square::h8);
-    set(Square::f8, Piece::rook, us());
+  if (capture != Piece::empty) {
+    unset(move.end());
   }
 
-  unset(info.start);
-  if (move.promotion != Piece::empty) {
-    set(info.end, move.promotion, us());
-  } else {
-    set(info.end, info.piece, us());
+  unset(move.start());
+  switch (move.kind()) {
+    case MoveKind::normal:
+      set(move.end(), piece, us());
+      break;
+    case MoveKind::castling: {
+      auto rook = castlingRooks[move.end()];
+      unset(rook.start);
+      set(rook.end, Piece::rook, us());
+      set(move.end(), piece, us());
+      break;
+    }
+    case MoveKind::enPassant:
+      unset(enPassantCapture(previousEnPassant));
+      set(move.end(), piece, us());
+      break;
+    case MoveKind::promotion:
+      set(move.end(), move.promotion(), us());
+      break;
   }
 
+  hash ^= Zobrist::blackToMove;
   next = them();
+  updateCheckInfo();
 }
 
-void GameState::undoMove() {
-  UndoInfo undo{undoStack.top()};
-  undoStack.pop();
+void GameState::undoMove(Move move) {
+  const UndoInfo &undo = undoStack[--undoCount];
+  Piece::t piece = getPiece(move.end());
+  if (move.kind() == MoveKind::promotion) {
+    piece = Piece::pawn;
+  }
 
   enPassantSquare = undo.enPassant;
   uneventfulHalfMoves = undo.uneventfulHalfMoves;
   castlingRights = undo.castlingRights;
   next = them();
 
-  unset(undo.end);
+  unset(move.end());
 
-  if (undo.flags != MoveFlags::enPassant && undo.capture != Piece::empty) {
-    set(undo.end, undo.capture, them());
+  if (undo.capture != Piece::empty) {
+    set(move.end(), undo.capture, them());
   }
 
-  if (undo.flags == MoveFlags::enPassant) {
-    Square::t captured = enPassantCapture(undo.enPassant);
-    set(captured, Piece::pawn, them());
-  } else if (undo.flags == MoveFlags::whiteQueenSide) {
-    unset(Square::d1);
-    set(Square::a1, Piece::rook, us());
-  } else if (undo.flags == MoveFlags::whiteKingSide) {
-    unset(Square::f1);
-    set(Square::h1, Piece::rook, us());
-  } else if (undo.flags == MoveFlags::blackQueenSide) {
-    unset(Square::d8);
-    set(Square::a8, Piece::rook, us());
-  } else if (undo.flags == MoveFlags::blackKingSide) {
-    unset(Square::f8);
-    set(Square::h8, Piece::rook, us());
+  if (move.kind() == MoveKind::enPassant) {
+    set(enPassantCapture(undo.enPassant), Piece::pawn, them());
+  } else if (move.kind() == MoveKind::castling) {
+    auto rook = castlingRooks[move.end()];
+    unset(rook.end);
+    set(rook.start, Piece::rook, us());
   }
 
-  if (undo.flags == MoveFlags::promotion) {
-    set(undo.start, Piece::pawn, us());
-  } else {
-    set(undo.start, undo.piece, us());
-  }
+  set(move.start(), piece, us());
+  hash = undo.hash;
+  const CheckInfo &checkInfo = checkInfoStack[undoCount];
+  checkers = checkInfo.checkers;
+  blockersForKing = checkInfo.blockersForKing;
+  checkSquares = checkInfo.checkSquares;
 }
 
 Move::Move(std::string const &algebraic)
-    : start{0}, end{0}, promotion{Piece::empty}, flags{0} {
-  start = Square::byName(algebraic[0], algebraic[1]);
-  end = Square::byName(algebraic[2], algebraic[3]);
-  if (algebraic.size() > 4) {
-    promotion = Piece::byName(algebraic[4]);
-  }
-}
+    : Move(Square::byName(algebraic[0], algebraic[1]),
+           Square::byName(algebraic[2], algebraic[3]),
+           algebraic.size() > 4 ? Piece::byName(algebraic[4])
+                                : static_cast<Piece::t>(Piece::empty)) {}
 
 std::vector<std::string> splitFenFields(std::string const &fenString) {
   std::istringstream iss(fenString);
@@ -471,7 +730,7 @@ std::vector<std::string> splitFenFields(std::string const &fenString) {
   return fields;
 }
 
-void GameState::parseFenString(const std::string &fenString) {
+void Position::parseFenString(const std::string &fenString) {
   std::vector<std::string> fields = splitFenFields(fenString);
   int file = 0;
   int rank = Coord::width - 1;
@@ -512,15 +771,30 @@ void GameState::parseFenString(const std::string &fenString) {
         break;
     }
   }
-  if (fields[3][0] == '-') {
-    enPassantSquare = Square::noSquare;
-  } else {
-    enPassantSquare = Square::byName(fields[3][0], fields[3][1]);
+  enPassantSquare = Square::noSquare;
+  if (fields[3][0] != '-') {
+    // Like in `makeMove`, only kept if one of our pawns can capture, so that
+    // the hash does not depend on how the position was reached.
+    Square::t passed = Square::byName(fields[3][0], fields[3][1]);
+    if (!(MoveTables::pawnAttacks(them(), passed) &
+          forPiece(Piece::pawn, us()))
+             .isEmpty()) {
+      enPassantSquare = passed;
+    }
   }
   uneventfulHalfMoves = std::stoi(fields[4]);
+
+  hash ^= Zobrist::castling(castlingRights);
+  if (Square::inRange(enPassantSquare)) {
+    hash ^= Zobrist::enPassant(enPassantSquare);
+  }
+  if (next == Color::black) {
+    hash ^= Zobrist::blackToMove;
+  }
+  updateCheckInfo();
 }
 
-std::ostream &operator<<(std::ostream &out, const GameState &state) {
+std::ostream &operator<<(std::ostream &out, const Position &state) {
   for (auto rank : Coord::reverseRanks) {
     out << (rank + 1) << " | ";
     for (auto file : Coord::files) {
@@ -548,9 +822,9 @@ std::ostream &operator<<(std::ostream &out, const GameState &state) {
 }
 
 std::ostream &operator<<(std::ostream &out, const Move &move) {
-  out << Square::name(move.start) << Square::name(move.end);
-  if (move.promotion != Piece::empty) {
-    out << Piece::name(move.promotion, Color::black);
+  out << Square::name(move.start()) << Square::name(move.end());
+  if (move.promotion() != Piece::empty) {
+    out << Piece::name(move.promotion(), Color::black);
   }
   return out;
 }
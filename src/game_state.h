@@ -3,60 +3,152 @@
 
 #include <array>
 #include <iostream>
-#include <stack>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "bitboard.h"
+#include "material.h"
 #include "movetables.h"
+#include "nnue.h"
+#include "psqt.h"
 #include "types.h"
 
 namespace Dagor {
 
+/// @brief A move packed into 16 bits: the start square, the end square, the
+/// `MoveKind` and, for promotions, the piece promoted to.
 class Move {
- public:
-  Square::t start;
-  Square::t end;
-  Piece::t promotion;
-  std::uint8_t flags;
+ private:
+  static constexpr unsigned endShift = 6;
+  static constexpr unsigned kindShift = 12;
+  static constexpr unsigned promotionShift = 14;
+
+  std::uint16_t data;
 
-  Move(Square::t start, Square::t end, Piece::t promotion = Piece::empty)
-      : start{start}, end{end}, promotion{promotion}, flags{0} {}
+  constexpr Move(Square::t start, Square::t end, MoveKind::t kind,
+                 unsigned promotionIndex)
+      : data{static_cast<std::uint16_t>(
+            start | (end << endShift) | (kind << kindShift) |
+            (promotionIndex << promotionShift))} {}
+
+ public:
+  constexpr Move() : data{0} {}
+  /// @brief A normal move or, if `promotion` is not empty, a promotion.
+  constexpr Move(Square::t start, Square::t end,
+                 Piece::t promotion = Piece::empty)
+      : Move(start, end,
+             promotion == Piece::empty ? MoveKind::normal
+                                       : MoveKind::promotion,
+             promotion == Piece::empty ? 0 : promotion - Piece::knight) {}
 
+  /// @brief Parses a move in the long algebraic notation of UCI. As the
+  /// notation does not tell castling and en passant apart from normal
+  /// moves, use `Position::parseMove` for moves that may be either.
   explicit Move(std::string const &algebraic);
+
+  static constexpr Move castling(Square::t start, Square::t end) {
+    return {start, end, MoveKind::castling, 0};
+  }
+  static constexpr Move enPassant(Square::t start, Square::t end) {
+    return {start, end, MoveKind::enPassant, 0};
+  }
+
+  constexpr Square::t start() const { return data & 0x3f; }
+  constexpr Square::t end() const { return (data >> endShift) & 0x3f; }
+  constexpr MoveKind::t kind() const { return (data >> kindShift) & 0x3; }
+  /// @return the piece promoted to, or `Piece::empty` if the move is no
+  /// promotion.
+  constexpr Piece::t promotion() const {
+    return kind() == MoveKind::promotion
+               ? static_cast<Piece::t>(Piece::knight + (data >> promotionShift))
+               : static_cast<Piece::t>(Piece::empty);
+  }
+
+  friend constexpr bool operator==(Move a, Move b) {
+    return a.data == b.data;
+  }
 };
+static_assert(sizeof(Move) == 2);
 
-const Move wkCastle{Square::e1, Square::g1};
-const Move wqCastle{Square::e1, Square::c1};
-const Move bkCastle{Square::e8, Square::g8};
-const Move bqCastle{Square::e8, Square::c8};
+constexpr Move wkCastle = Move::castling(Square::e1, Square::g1);
+constexpr Move wqCastle = Move::castling(Square::e1, Square::c1);
+constexpr Move bkCastle = Move::castling(Square::e8, Square::g8);
+constexpr Move bqCastle = Move::castling(Square::e8, Square::c8);
 
-inline bool operator==(Move const &a, Move const &b) {
-  return a.start == b.start && a.end == b.end && a.promotion == b.promotion &&
-         a.flags == b.flags;
-}
+/// @brief The kinds of legal moves a move generator can be asked for.
+namespace GenerationMode {
+using t = std::uint8_t;
+enum : t {
+  /// @brief All legal moves.
+  all,
+  /// @brief Captures (including en passant) and all promotions.
+  captures,
+  /// @brief Everything else: moves to empty squares that do not promote.
+  quiets,
+  /// @brief All legal moves, for positions where the side to move is in
+  /// check.
+  evasions,
+  /// @brief The quiet moves that give check.
+  quietChecks,
+};
+}  // namespace GenerationMode
+
+/// @brief A list of moves with a fixed capacity, large enough for the legal
+/// moves of any position. It lives inline (on the stack or in a search frame),
+/// so generating moves into it never allocates.
+class MoveList {
+ public:
+  /// @brief The most legal moves any chess position has is 218.
+  static constexpr std::size_t capacity = 256;
 
-class GameState;
+ private:
+  std::array<Move, capacity> moves;
+  std::size_t count;
 
+ public:
+  MoveList() : moves(), count{0} {}
+
+  void push_back(Move move) { moves[count++] = move; }
+  void clear() { count = 0; }
+  std::size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  Move &operator[](std::size_t i) { return moves[i]; }
+  const Move &operator[](std::size_t i) const { return moves[i]; }
+
+  Move *begin() { return moves.data(); }
+  Move *end() { return moves.data() + count; }
+  const Move *begin() const { return moves.data(); }
+  const Move *end() const { return moves.data() + count; }
+};
+
+/// @brief The state that a move destroys irreversibly and that `undoMove`
+/// therefore has to restore. Everything else follows from the move itself.
 struct UndoInfo {
-  Piece::t piece;
-  Piece::t capture;
-  Square::t start;
-  Square::t end;
-  Square::t enPassant;
-  CastlingRights::t castlingRights;
-  std::uint8_t uneventfulHalfMoves;
-  /// @brief Flags marking special Moves:
-  ///
-  /// - `0`: a normal move
-  /// - `1, 2, 3, 4`: a castle move
-  /// - `5` an en passant capture
-  MoveFlags::t flags;
-
-  UndoInfo(const GameState &state, const Move &move);
+  std::uint64_t hash = 0;
+  Piece::t capture = Piece::empty;
+  CastlingRights::t castlingRights = CastlingRights::none;
+  Square::t enPassant = Square::noSquare;
+  std::uint8_t uneventfulHalfMoves = 0;
 };
 
-class GameState {
+static_assert(sizeof(UndoInfo) == 16, "The undo record should stay compact.");
+
+/// @brief The check information of a position (see
+/// `Position::updateCheckInfo`), saved by `GameState::executeMove` so that
+/// `GameState::undoMove` restores it instead of computing it again.
+struct CheckInfo {
+  BitBoards::BitBoard checkers{};
+  std::array<BitBoards::BitBoard, Color::size> blockersForKing{};
+  std::array<BitBoards::BitBoard, Piece::all.size()> checkSquares{};
+};
+
+/// @brief The board and everything else that makes up a chess position,
+/// without any history. It is a small, trivially copyable value, so that it
+/// can be copied for each ply (see `apply`) as an alternative to
+/// `GameState::executeMove`/`GameState::undoMove`.
+class alignas(64) Position {
  public:
   static inline const std::string startingPosition =
       "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
@@ -64,34 +156,48 @@ class GameState {
   std::array<Piece::t, Square::size> mailbox;
   std::array<BitBoards::BitBoard, Piece::all.size()> pieces;
   std::array<BitBoards::BitBoard, Color::size> colors;
-  std::stack<UndoInfo> undoStack;
+  /// @brief The Zobrist hash of the position, see `Dagor::Zobrist`.
+  std::uint64_t hash;
+  /// @brief The Zobrist hash of the pawns alone, the key of the pawn hash
+  /// table (see `Eval::PawnTable`).
+  std::uint64_t pawnKey;
+  /// @brief The number of pieces of each type and color, the index of the
+  /// material table (see `Eval::materialEntry`).
+  Eval::MaterialKey materialKey;
   std::uint8_t uneventfulHalfMoves;
   CastlingRights::t castlingRights;
   Square::t enPassantSquare;
   Color::t next;
+  /// @brief The material and piece-square score of all pieces from white’s
+  /// point of view, kept up to date by `set` and `unset`.
+  Eval::Score psqt;
 
-  GameState()
-      : mailbox(),
-        pieces(),
-        colors(),
-        undoStack(),
-        uneventfulHalfMoves{0},
-        castlingRights{CastlingRights::none},
-        enPassantSquare{Square::noSquare},
-        next{Color::white} {
-    mailbox.fill(Piece::empty);
-    parseFenString(startingPosition);
-  }
+  /// @brief The opponent’s pieces that give check to our king.
+  BitBoards::BitBoard checkers;
+  /// @brief By color, the pieces (of either color) that are the only piece
+  /// between that color’s king and an enemy slider. For our own pieces, these
+  /// are the pinned pieces, for the opponent’s, those that can give a
+  /// discovered check.
+  std::array<BitBoards::BitBoard, Color::size> blockersForKing;
+  /// @brief By piece type, the squares from where one of our pieces of that
+  /// type would attack the opponent’s king.
+  std::array<BitBoards::BitBoard, Piece::all.size()> checkSquares;
 
-  explicit GameState(std::string const &fen)
+  explicit Position(std::string const &fen)
       : mailbox(),
         pieces(),
         colors(),
-        undoStack(),
+        hash{0},
+        pawnKey{0},
+        materialKey{0},
         uneventfulHalfMoves{0},
         castlingRights{CastlingRights::none},
         enPassantSquare{Square::noSquare},
-        next{Color::white} {
+        next{Color::white},
+        psqt{0},
+        checkers(),
+        blockersForKing(),
+        checkSquares() {
     mailbox.fill(Piece::empty);
     parseFenString(fen);
   }
@@ -115,6 +221,11 @@ class GameState {
 
   void unset(Square::t square) {
     Piece::t piece = getPiece(square);
+    Color::t color = getColor(square);
+    hash ^= Zobrist::piece(piece, color, square);
+    if (piece == Piece::pawn) pawnKey ^= Zobrist::piece(piece, color, square);
+    materialKey -= Eval::materialKey(piece, color);
+    psqt -= Eval::pieceSquare(piece, color, square);
     mailbox[square] = Piece::empty;
     pieces[piece].unsetSquare(square);
     colors[Color::white].unsetSquare(square);
@@ -122,6 +233,10 @@ class GameState {
   }
 
   void set(Square::t square, Piece::t piece, Color::t color) {
+    hash ^= Zobrist::piece(piece, color, square);
+    if (piece == Piece::pawn) pawnKey ^= Zobrist::piece(piece, color, square);
+    materialKey += Eval::materialKey(piece, color);
+    psqt += Eval::pieceSquare(piece, color, square);
     mailbox[square] = piece;
     pieces[piece].setSquare(square);
     colors[color].setSquare(square);
@@ -130,6 +245,35 @@ class GameState {
   inline Color::t us() const { return next; }
   inline Color::t them() const { return Color::opponent(us()); }
 
+  /// @brief The moves of a piece whose type and color are known at compile
+  /// time, so that the dispatch on the type and the pawn direction cost
+  /// nothing. No special moves: en passant and castling.
+  template <Piece::t piece, Color::t color>
+  BitBoards::BitBoard getMoves(Square::t square,
+                               BitBoards::BitBoard occupancy) const {
+    BitBoards::BitBoard moves;
+    if constexpr (piece == Piece::pawn) {
+      constexpr int up = color == Color::white ? Square::north : Square::south;
+      constexpr Coord::t startRank = color == Color::white ? 1 : 6;
+      moves = BitBoards::single(square + up) & ~occupancy;
+      if (Square::rank(square) == startRank && !moves.isEmpty()) {
+        moves |= BitBoards::single(square + 2 * up) & ~occupancy;
+      }
+      moves |= MoveTables::pawnAttacks(color, square) & occupancy;
+    } else if constexpr (piece == Piece::knight) {
+      moves = MoveTables::knightMoves(square);
+    } else if constexpr (piece == Piece::king) {
+      moves = MoveTables::kingMoves(square);
+    } else if constexpr (piece == Piece::bishop) {
+      moves = MoveTables::bishopMoves(square, occupancy);
+    } else if constexpr (piece == Piece::rook) {
+      moves = MoveTables::rookMoves(square, occupancy);
+    } else if constexpr (piece == Piece::queen) {
+      moves = MoveTables::bishopMoves(square, occupancy) |
+              MoveTables::rookMoves(square, occupancy);
+    }
+    return moves & ~forColor(color);
+  }
   BitBoards::BitBoard getMoves(Piece::t piece, Color::t color,
                                Square::t square) const;
   BitBoards::BitBoard getMoves(Piece::t piece, Color::t color, Square::t square,
@@ -137,23 +281,168 @@ class GameState {
   BitBoards::BitBoard getAttacks(Square::t square, Color::t color) const;
   BitBoards::BitBoard getAttacks(Square::t square, Color::t color,
                                  BitBoards::BitBoard occupancy) const;
-  bool isCheck();
+  /// @brief All the squares attacked by the pieces of `color`.
+  /// @param color the attacking side.
+  /// @param occupancy the pieces that block the sliders.
+  /// @return the union of the attacks of all pieces of `color`, regardless
+  /// of whether a piece of the same color stands on the attacked square.
+  BitBoards::BitBoard attackMap(Color::t color,
+                                BitBoards::BitBoard occupancy) const;
+  /// @brief All the squares attacked by the pieces of `color` on this board.
+  /// The sliders are filled all at once with `BitBoards::slidingAttacks`
+  /// (AVX2 where available), which pays off when a side has many of them;
+  /// the move generator, where it does not, uses the overload above.
+  BitBoards::BitBoard attackMap(Color::t color) const;
+  bool isCheck() const { return !checkers.isEmpty(); }
+  /// @brief Checks whether a legal move would give check to the opponent.
+  bool givesCheck(Move move) const;
+  /// @brief Recomputes `checkers`, `blockersForKing` and `checkSquares`. This
+  /// is done once per move by `makeMove`; `GameState::undoMove` restores
+  /// the information saved before the move instead.
+  void updateCheckInfo();
 
   std::vector<Move> generateLegalMoves() const;
+  void generateLegalMoves(MoveList &moves) const;
+  /// @brief Generates only the legal moves of the given kind, see
+  /// `GenerationMode`. The list is cleared first.
+  template <GenerationMode::t mode>
+  void generateMoves(MoveList &moves) const;
+  /// @brief Like `generateMoves`, but the moves are only pseudo-legal: they
+  /// may leave the own king in check. Filter them with `isLegal`, ideally
+  /// only for the moves that are actually played.
+  template <GenerationMode::t mode>
+  void generatePseudoLegalMoves(MoveList &moves) const;
+  /// @brief Checks whether a pseudo-legal move of this position is legal,
+  /// from the blockers and check information of the position.
+  bool isLegal(Move move) const;
+  /// @brief Parses a move in UCI notation and finds out its kind from this
+  /// position.
+  /// @throws std::invalid_argument if it is no legal move here.
+  Move parseMove(const std::string &algebraic) const;
 
-  void executeMove(Move move);
-  void undoMove();
+  /// @brief Makes a move in place, without keeping what is needed to undo it.
+  void makeMove(Move move);
+  /// @brief Copy-make: the position after the move, leaving this one as it is.
+  Position apply(Move move) const {
+    Position after{*this};
+    after.makeMove(move);
+    return after;
+  }
   void parseFenString(const std::string &fenString);
 };
 
-inline bool operator==(const GameState &a, const GameState &b) {
+static_assert(std::is_trivially_copyable_v<Position>,
+              "Copy-make relies on positions being plain values.");
+static_assert(sizeof(Position) == 256,
+              "A Position should fill exactly four cache lines.");
+
+/// @brief Whether this build prefers copy-make (`Position::apply`) over
+/// make/unmake (`GameState::executeMove`, `GameState::undoMove`) where both
+/// are possible. Chosen with the Makefile variable `COPY_MAKE` after comparing
+/// both with `release perft`.
+#ifdef DAGOR_COPY_MAKE
+constexpr bool copyMake = true;
+#else
+constexpr bool copyMake = false;
+#endif
+
+/// @brief A position together with the information to take back the moves
+/// that led to it.
+class GameState : public Position {
+ public:
+  /// @brief The number of moves that can be made (and not yet undone). This
+  /// only needs to cover the search depth (`Search::maxPly`, quiescence
+  /// included) and a few moves made before a search: moves that are never
+  /// taken back (such as those of a UCI `position` command) are made with
+  /// `makeMove`. Kept small, as every copy of a `GameState` copies the stack.
+  static constexpr std::size_t undoCapacity = 128;
+
+  /// @brief A stack of fixed capacity, where `undoCount` is the number of
+  /// entries in use. This keeps copying a `GameState` a plain copy and making
+  /// a move free of allocations.
+  std::array<UndoInfo, undoCapacity> undoStack;
+  /// @brief By the same index as `undoStack`, the check information before
+  /// each move. It is kept apart, so that the undo records stay compact.
+  std::array<CheckInfo, undoCapacity> checkInfoStack;
+  std::uint16_t undoCount;
+  /// @brief The NNUE accumulators of the moves made since
+  /// `attachAccumulators`, the current one at `undoCount - accumulatorBase`,
+  /// or `nullptr`. They belong to the search (`Search::Searcher`), which
+  /// attaches them only while the network is enabled. Copies of the state
+  /// do not share them.
+  NNUE::Accumulator *accumulators;
+  std::uint16_t accumulatorBase;
+
+  GameState() : GameState(startingPosition) {}
+
+  explicit GameState(std::string const &fen)
+      : Position(fen),
+        undoStack(),
+        checkInfoStack(),
+        undoCount{0},
+        accumulators{nullptr},
+        accumulatorBase{0} {}
+
+  /// @brief Copies the position and the moves that can be taken back, but
+  /// not the accumulators: they belong to the search of the original, which
+  /// may end before the copy does.
+  GameState(const GameState &other)
+      : Position(other),
+        undoStack(other.undoStack),
+        checkInfoStack(other.checkInfoStack),
+        undoCount{other.undoCount},
+        accumulators{nullptr},
+        accumulatorBase{0} {}
+  GameState &operator=(const GameState &other) {
+    Position::operator=(other);
+    undoStack = other.undoStack;
+    checkInfoStack = other.checkInfoStack;
+    undoCount = other.undoCount;
+    accumulators = nullptr;
+    accumulatorBase = 0;
+    return *this;
+  }
+
+  /// @brief Makes a move and keeps what is needed to take it back.
+  /// @throws std::length_error if `undoCapacity` moves have been made and
+  /// not taken back.
+  void executeMove(Move move);
+  /// @brief Takes back the last move made with `executeMove`.
+  /// @param move the move to take back; the same as given to `executeMove`.
+  void undoMove(Move move);
+
+  /// @brief Keeps the accumulators of the current position and of the moves
+  /// made from here on in `stack`, which must have room for one more than
+  /// the moves made before `detachAccumulators`. The current accumulator is
+  /// computed from scratch.
+  void attachAccumulators(NNUE::Accumulator *stack) {
+    accumulators = stack;
+    accumulatorBase = undoCount;
+    NNUE::refresh(*this, accumulators[0]);
+  }
+  void detachAccumulators() { accumulators = nullptr; }
+  /// @return the current accumulator, or `nullptr` if none are attached.
+  const NNUE::Accumulator *accumulator() const {
+    return accumulators == nullptr ? nullptr
+                                   : &accumulators[undoCount - accumulatorBase];
+  }
+
+ private:
+  /// @brief Computes the accumulator after `move` from the current one.
+  /// Called by `executeMove` after pushing the undo information.
+  void updateAccumulator(Move move);
+};
+
+inline bool operator==(const Position &a, const Position &b) {
   return a.pieces == b.pieces && a.colors == b.colors &&
          a.uneventfulHalfMoves == b.uneventfulHalfMoves &&
          a.castlingRights == b.castlingRights &&
-         a.enPassantSquare == b.enPassantSquare && a.next == b.next;
+         a.enPassantSquare == b.enPassantSquare && a.next == b.next &&
+         a.hash == b.hash && a.pawnKey == b.pawnKey &&
+         a.materialKey == b.materialKey;
 }
 
-std::ostream &operator<<(std::ostream &out, const GameState &board);
+std::ostream &operator<<(std::ostream &out, const Position &board);
 std::ostream &operator<<(std::ostream &out, const Move &move);
 
 }  // namespace Dagor
@@ -3,12 +3,16 @@
  *  moves for a given position to speed up move generation in the search.
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdlib>
 #include <fstream>
 #include <ios>
 #include <iostream>
+#include <optional>
 #include <random>
+#include <thread>
 #include <vector>
 
 #include "bitboard.h"
@@ -300,20 +304,12 @@ BitBoard spreadBitsInMask(unsigned bitsToSpread, BitBoard mask) {
   return result;
 }
 
-/// @brief Generates an uniformly distributed uint64.
-/// @return the random number.
-std::uint64_t randomLong() {
-  static std::mt19937_64 engine{
-      0};  // we want a predictable generator, NOLINT(*-msc51-cpp)
-  static std::uniform_int_distribution<std::uint64_t> distribution{};
-  return distribution(engine);
-}
-
 /// @brief Generates a random number with a bias towards numbers where only a
 /// few bits are set.
+/// @param engine a predictable generator.
 /// @return the random number.
-std::uint64_t randomFewBitsSet() {
-  return randomLong() & randomLong() & randomLong();
+std::uint64_t randomFewBitsSet(std::mt19937_64 &engine) {
+  return engine() & engine() & engine();
 }
 
 /// @brief Generates all possibilities for how blocking pieces can be
@@ -360,111 +356,467 @@ class SliderInfo {
         moves(generatePossibleMoves(square, blockers, isBishop)) {}
 };
 
+#ifndef DAGOR_HYPERBOLA
+
+/// @brief The hash function of one square together with the table it
+/// indexes. Slots that no configuration of blockers is hashed to are unused
+/// and may hold anything, which is what lets tables overlap.
+class SliderTable {
+ public:
+  std::uint64_t magic;
+  unsigned downShift;
+  vector<BitBoard> entries;
+  vector<bool> used;
+
+  SliderTable() : magic{0}, downShift{64}, entries(), used() {}
+
+  /// @brief Tries to build the table for a candidate hash function. Two
+  /// configurations of blockers may share a slot if they allow the same
+  /// moves (a constructive collision).
+  /// @return `false` if two configurations with different moves collide.
+  bool tryHash(const SliderInfo &info, std::uint64_t candidate,
+               unsigned bits) {
+    magic = candidate;
+    downShift = 64 - bits;
+    entries.assign(std::size_t{1} << bits, {});
+    used.assign(std::size_t{1} << bits, false);
+    MoveTables::BlockerHash hash{nullptr, info.blockerMask.asUint(), magic,
+                                 downShift};
+    for (std::size_t i = 0; i < info.blockers.size(); i++) {
+      unsigned h = hash.hash(info.blockers[i]);
+      if (used[h] && entries[h] != info.moves[i]) return false;
+      used[h] = true;
+      entries[h] = info.moves[i];
+    }
+    return true;
+  }
+};
+
+/// @brief The number of candidates tried per square for a magic with one
+/// index bit fewer than the mask has squares. These can only exist through
+/// constructive collisions and are rare, so the search is bounded.
+constexpr unsigned reducedTries = 1u << 16;
+
 /// @brief Finds the configuration for a perfect hash function for the
-/// powerset of the given mask.
-/// @param mask
-/// @return An object implementing the hash function.
-/// `MoveTables::BlockerHash({0}, {0}, 0, 0)` is returned if the generation has
-/// failed.
-MoveTables::BlockerHash findPerfectHash(SliderInfo &info) {
+/// powerset of the given mask, preferring one with fewer index bits than the
+/// mask has squares. With `DAGOR_PEXT` the hash needs no magic.
+/// @param info
+/// @return the hash function with its table, or `std::nullopt` if the
+/// generation has failed.
+std::optional<SliderTable> findPerfectHash(const SliderInfo &info) {
+  // every square gets a generator of its own, so that the result does not
+  // depend on how the squares are distributed among threads
+  std::mt19937_64 engine{info.square * 2u + info.isBishop};
+  unsigned bits = info.blockerMask.populationCount();
+  SliderTable table;
+#ifdef DAGOR_PEXT
+  table.tryHash(info, 0, bits);
+  return table;
+#endif
   unsigned maxTries = 1u << 31;
-  int bitCount = info.blockerMask.populationCount();
-
-  for (unsigned k = 0; k < maxTries; k++) {
-    MoveTables::BlockerHash candidate{info.blockerMask.asUint(),
-                                      randomFewBitsSet(),
-                                      static_cast<unsigned>(64 - bitCount), 0};
-    vector<bool> hits(info.blockers.size(), false);
-    bool failed = false;
-    for (unsigned i = 0; !failed && i < info.blockers.size(); i++) {
-      unsigned hash = candidate.hash(info.blockers[i]);
-      if (hits[hash])
-        failed = true;
-      else
-        hits[hash] = true;
-    }
-    if (!failed) {
-      return candidate;
+  bool found = false;
+  for (unsigned k = 0; !found && k < maxTries; k++) {
+    found = table.tryHash(info, randomFewBitsSet(engine), bits);
+  }
+  if (!found) {
+    return std::nullopt;
+  }
+  SliderTable reduced;
+  for (unsigned k = 0; k < reducedTries; k++) {
+    if (reduced.tryHash(info, randomFewBitsSet(engine), bits - 1)) {
+      return reduced;
     }
   }
-  std::cerr << "Hash generation has failed!";
-  return {{0}, {0}, 0, 0};
+  return table;
 }
 
-/// @brief Write the representation of a hash function to a file
-/// @param f
-/// @param hash
-/// @param offset a new offset, potentially differing from the one
-/// specified in the hash function.
-void writeHash(std::ostream &f, MoveTables::BlockerHash &hash,
-               unsigned offset) {
-  f << "{" << hash.blockerMask << "ULL, " << hash.magic << "ULL, "
-    << hash.downShift << "U, " << offset << "U}";
+/// @brief Searches the hash functions of all squares on all cores. Exits
+/// the generator with an error if one of them cannot be found, so that no
+/// invalid table is written.
+/// @return the tables of the bishops, followed by those of the rooks.
+vector<SliderTable> findAllHashes(const vector<SliderInfo> &infos) {
+  vector<SliderTable> tables(infos.size());
+  std::atomic<std::size_t> next{0};
+  std::atomic<bool> failed{false};
+  auto work = [&]() {
+    for (std::size_t i = next++; i < infos.size(); i = next++) {
+      if (auto table = findPerfectHash(infos[i])) {
+        tables[i] = std::move(*table);
+      } else {
+        failed = true;
+      }
+    }
+  };
+  unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+  vector<std::thread> threads;
+  for (unsigned t = 0; t < threadCount; t++) {
+    threads.emplace_back(work);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  if (failed) {
+    std::cerr << "Hash generation has failed!\n";
+    std::exit(EXIT_FAILURE);
+  }
+  return tables;
 }
 
-void initHashFunctions(vector<SliderInfo> &squareInfo,
-                       vector<MoveTables::BlockerHash> &hashFunctions,
-                       unsigned &numberOfMoves, bool isBishop) {
-  for (auto square : Square::all) {
-    SliderInfo info(isBishop, square);
-    squareInfo.push_back(info);
-    MoveTables::BlockerHash hash{findPerfectHash(info)};
-    hashFunctions.push_back(hash);
-    numberOfMoves += info.moves.size();
+/// @brief Lays out all tables in one array, each at the first offset where
+/// its used slots only meet unused slots or equal entries.
+/// @param tables
+/// @param moves receives the packed array.
+/// @return the offset of each table.
+vector<std::size_t> packTables(const vector<SliderTable> &tables,
+                               vector<BitBoard> &moves) {
+  vector<bool> used;
+  vector<std::size_t> offsets(tables.size());
+  // the big tables first, the small ones fill the gaps
+  vector<std::size_t> order(tables.size());
+  for (std::size_t i = 0; i < order.size(); i++) order[i] = i;
+  std::stable_sort(order.begin(), order.end(),
+                   [&tables](std::size_t a, std::size_t b) {
+                     return tables[a].entries.size() > tables[b].entries.size();
+                   });
+
+  for (std::size_t t : order) {
+    const SliderTable &table = tables[t];
+    auto fits = [&](std::size_t offset) {
+      for (std::size_t i = 0; i < table.entries.size(); i++) {
+        if (table.used[i] && offset + i < moves.size() && used[offset + i] &&
+            moves[offset + i] != table.entries[i]) {
+          return false;
+        }
+      }
+      return true;
+    };
+    std::size_t offset = 0;
+    while (!fits(offset)) offset++;
+    if (offset + table.entries.size() > moves.size()) {
+      moves.resize(offset + table.entries.size());
+      used.resize(offset + table.entries.size(), false);
+    }
+    for (std::size_t i = 0; i < table.entries.size(); i++) {
+      if (table.used[i]) {
+        moves[offset + i] = table.entries[i];
+        used[offset + i] = true;
+      }
+    }
+    offsets[t] = offset;
   }
+  return offsets;
 }
 
-void hashMoves(vector<BitBoard> &moves, vector<SliderInfo> &squareInfo,
-               vector<MoveTables::BlockerHash> &hashFunctions,
-               unsigned &currentOffset) {
-  for (auto square : Square::all) {
-    MoveTables::BlockerHash hash{hashFunctions[square]};
-    SliderInfo info{squareInfo[square]};
-    for (unsigned i = 0; i < info.blockers.size(); i++) {
-      unsigned h = hash.hash(info.blockers[i]) + currentOffset;
-      moves[h] = info.moves[i];
+void writeSlidingPieces(std::ostream &f) {
+  vector<SliderInfo> infos;
+  for (bool isBishop : {true, false}) {
+    for (auto square : Square::all) {
+      infos.emplace_back(isBishop, square);
+    }
+  }
+  vector<SliderTable> tables = findAllHashes(infos);
+  vector<BitBoard> moves;
+  vector<std::size_t> offsets = packTables(tables, moves);
+
+  std::size_t unpacked = 0;
+  for (const auto &info : infos) unpacked += info.moves.size();
+  std::cout << "slider moves: " << moves.size() << " entries instead of "
+            << unpacked << "\n";
+
+  f << "alignas(64) const std::uint64_t slidingMoves[] = {\n";
+  for (unsigned i = 0; i < moves.size(); i++) {
+    f << moves[i].asUint() << "ULL";
+    if (i < moves.size() - 1) f << ",\n";
+  }
+  f << "\n};\n\n";
+
+  for (bool isBishop : {true, false}) {
+    f << "alignas(64) const std::array<BlockerHash, Square::size> "
+      << (isBishop ? "bishopHashes" : "rookHashes") << " = {{\n";
+    for (auto square : Square::all) {
+      std::size_t i = (isBishop ? 0 : Square::size) + square;
+      f << "{slidingMoves + " << offsets[i] << ", "
+        << infos[i].blockerMask.asUint() << "ULL, " << tables[i].magic
+        << "ULL, " << tables[i].downShift << "U}";
+      if (square < Square::size - 1) f << ",\n";
     }
-    currentOffset += squareInfo[square].moves.size();
+    f << "\n}};\n\n";
   }
 }
 
-void writeSlidingPieces(std::ostream &f) {
-  vector<SliderInfo> bishopInfo;
-  vector<MoveTables::BlockerHash> bishopHashes;
-  vector<SliderInfo> rookInfo;
-  vector<MoveTables::BlockerHash> rookHashes;
-  unsigned numberOfMoves = 0;
-  initHashFunctions(bishopInfo, bishopHashes, numberOfMoves, true);
-  initHashFunctions(rookInfo, rookHashes, numberOfMoves, false);
-
-  vector<BitBoard> moves(numberOfMoves);
-  unsigned currentOffset = 0;
-  hashMoves(moves, bishopInfo, bishopHashes, currentOffset);
-  hashMoves(moves, rookInfo, rookHashes, currentOffset);
-
-  currentOffset = 0;
-  f << "const std::array<BlockerHash, Square::size> bishopHashes = {{\n";
+#endif
+
+/// @brief Writes the masks and the rank table for hyperbola quintessence.
+/// @param f
+void writeHyperbolaMasks(std::ostream &f) {
+  f << "const std::array<std::array<std::uint64_t, 3>, Square::size> "
+       "_lineMasks = {{\n";
   for (auto square : Square::all) {
-    writeHash(f, bishopHashes[square], currentOffset);
-    currentOffset += bishopInfo[square].moves.size();
+    BitBoard diagonal = bishopMoveRay(square, true, true, {}) |
+                        bishopMoveRay(square, false, false, {});
+    BitBoard antiDiagonal = bishopMoveRay(square, true, false, {}) |
+                            bishopMoveRay(square, false, true, {});
+    BitBoard file =
+        rookMoveRay(square, 0, 1, {}) | rookMoveRay(square, 0, -1, {});
+    f << "{" << diagonal.asUint() << "ULL, " << antiDiagonal.asUint()
+      << "ULL, " << file.asUint() << "ULL}";
     if (square < Square::size - 1) f << ",\n";
   }
   f << "\n}};\n\n";
 
-  f << "const std::array<BlockerHash, Square::size> rookHashes = {{\n";
-  for (auto square : Square::all) {
-    writeHash(f, rookHashes[square], currentOffset);
-    currentOffset += rookInfo[square].moves.size();
-    if (square < Square::size - 1) f << ",\n";
+  f << "const std::array<std::array<std::uint8_t, 64>, Coord::width> "
+       "_rankAttacks = {{\n";
+  for (Coord::t file = 0; file < Coord::width; file++) {
+    f << "{";
+    for (unsigned inner = 0; inner < 64; inner++) {
+      BitBoard attacks = rookMoves(file, BitBoard{inner << 1}) &
+                         BitBoards::wholeRank(0);
+      f << attacks.asUint();
+      if (inner < 63) f << ",";
+    }
+    f << "}";
+    if (file < Coord::width - 1) f << ",\n";
   }
   f << "\n}};\n\n";
+}
 
-  f << "const std::uint64_t slidingMoves[] = {\n";
-  for (unsigned i = 0; i < moves.size(); i++) {
-    f << "{" << moves[i].asUint() << "UL}";
-    if (i < moves.size() - 1) f << ",\n";
+/// @brief Writes the tables of squares between two squares and of the whole
+/// lines through two squares, for all pairs of squares that share a rank,
+/// file or diagonal. Other pairs map to the empty bitboard.
+/// @param f
+void writeLines(std::ostream &f) {
+  vector<BitBoard> between, lines;
+  for (auto a : Square::all) {
+    for (auto b : Square::all) {
+      BitBoard ab = BitBoards::single(a) | BitBoards::single(b);
+      if (a != b && bishopMoves(a, {}).isSet(b)) {
+        between.push_back(bishopMoves(a, BitBoards::single(b)) &
+                          bishopMoves(b, BitBoards::single(a)));
+        lines.push_back((bishopMoves(a, {}) & bishopMoves(b, {})) | ab);
+      } else if (a != b && rookMoves(a, {}).isSet(b)) {
+        between.push_back(rookMoves(a, BitBoards::single(b)) &
+                          rookMoves(b, BitBoards::single(a)));
+        lines.push_back((rookMoves(a, {}) & rookMoves(b, {})) | ab);
+      } else {
+        between.push_back({});
+        lines.push_back({});
+      }
+    }
   }
-  f << "\n};\n\n";
+
+  auto writeTable = [&f](const char *name, const vector<BitBoard> &table) {
+    f << "const std::array<std::array<std::uint64_t, Square::size>, "
+         "Square::size> "
+      << name << " = {{\n";
+    for (auto a : Square::all) {
+      f << "{";
+      for (auto b : Square::all) {
+        f << table[a * Square::size + b].asUint() << "ULL";
+        if (b < Square::size - 1) f << ",";
+      }
+      f << "}";
+      if (a < Square::size - 1) f << ",\n";
+    }
+    f << "\n}};\n\n";
+  };
+  writeTable("_between", between);
+  writeTable("_lines", lines);
+}
+
+/// @brief Writes the random numbers for Zobrist hashing: one per piece,
+/// color and square, one per combination of castling rights, one per file of
+/// the en passant square and one for black being the next to move.
+/// @param f
+void writeZobristKeys(std::ostream &f) {
+  // a generator of its own, so that the keys do not change the magics
+  std::mt19937_64 engine{0x5A0B0157};  // NOLINT(*-msc51-cpp)
+  std::uniform_int_distribution<std::uint64_t> distribution{};
+
+  f << "namespace Dagor::Zobrist {\n\n";
+  f << "const std::array<std::array<std::uint64_t, Square::size>, "
+       "Color::size * Piece::all.size()> _pieces = {{\n";
+  for (unsigned i = 0; i < Color::size * Piece::all.size(); i++) {
+    f << "{";
+    for (auto square : Square::all) {
+      f << distribution(engine) << "ULL";
+      if (square < Square::size - 1) f << ",";
+    }
+    f << "}";
+    if (i < Color::size * Piece::all.size() - 1) f << ",\n";
+  }
+  f << "\n}};\n\n";
+
+  f << "const std::array<std::uint64_t, CastlingRights::fullRights + 1> "
+       "_castling = {\n";
+  for (unsigned rights = 0; rights <= CastlingRights::fullRights; rights++) {
+    f << (rights == CastlingRights::none ? 0 : distribution(engine)) << "ULL";
+    if (rights < CastlingRights::fullRights) f << ",\n";
+  }
+  f << "};\n\n";
+
+  f << "const std::array<std::uint64_t, Coord::width> _enPassant = {\n";
+  for (auto file : Coord::files) {
+    f << distribution(engine) << "ULL";
+    if (file < Coord::width - 1) f << ",\n";
+  }
+  f << "};\n\n";
+
+  f << "const std::uint64_t blackToMove = " << distribution(engine)
+    << "ULL;\n\n";
+  f << "}\n";
+}
+
+/// @brief What is known about a position in the KPK bitbase while it is
+/// being generated.
+namespace KpkResult {
+using t = std::uint8_t;
+enum : t { unknown, invalid, draw, win };
+}  // namespace KpkResult
+
+/// @brief Classifies a KPK position with white to move by its successors:
+/// a win if one of white's moves wins, a draw if all of them draw.
+KpkResult::t classifyWhiteToMove(const vector<KpkResult::t> &results,
+                                 Square::t whiteKing, Square::t pawn,
+                                 Square::t blackKing) {
+  bool allDraws = true;
+  auto visit = [&](Square::t king, Square::t pawnTo) {
+    KpkResult::t result =
+        results[KPK::index(Color::black, king, pawnTo, blackKing)];
+    allDraws &= result == KpkResult::draw;
+    return result == KpkResult::win;
+  };
+  BitBoard kingTargets = kingMove(whiteKing) & ~kingMove(blackKing) &
+                         ~BitBoards::single(pawn);
+  for (Square::t target : kingTargets) {
+    if (visit(target, pawn)) return KpkResult::win;
+  }
+  // promotions were settled before, when they win right away
+  Square::t push = pawn + Square::north;
+  if (Square::rank(pawn) < Coord::width - 2 && push != whiteKing &&
+      push != blackKing) {
+    if (visit(whiteKing, push)) return KpkResult::win;
+    Square::t doublePush = push + Square::north;
+    if (Square::rank(pawn) == 1 && doublePush != whiteKing &&
+        doublePush != blackKing && visit(whiteKing, doublePush)) {
+      return KpkResult::win;
+    }
+  }
+  return allDraws ? KpkResult::draw : KpkResult::unknown;
+}
+
+/// @brief Classifies a KPK position with black to move by its successors:
+/// a draw if one of black's moves draws, a win if all of them lose.
+KpkResult::t classifyBlackToMove(const vector<KpkResult::t> &results,
+                                 Square::t whiteKing, Square::t pawn,
+                                 Square::t blackKing) {
+  bool allWins = true;
+  // captures of the pawn were settled before
+  BitBoard kingTargets = kingMove(blackKing) & ~kingMove(whiteKing) &
+                         ~pawnAttack(pawn, Color::white) &
+                         ~BitBoards::single(pawn);
+  for (Square::t target : kingTargets) {
+    KpkResult::t result =
+        results[KPK::index(Color::white, whiteKing, pawn, target)];
+    if (result == KpkResult::draw) return KpkResult::draw;
+    allWins &= result == KpkResult::win;
+  }
+  return allWins ? KpkResult::win : KpkResult::unknown;
+}
+
+/// @brief The result of a KPK position that is known without looking at
+/// its successors: illegal positions, promotions that cannot be stopped,
+/// captures of an undefended pawn, mates and stalemates.
+KpkResult::t initialKpkResult(Color::t us, Square::t whiteKing,
+                              Square::t pawn, Square::t blackKing) {
+  if (whiteKing == blackKing || whiteKing == pawn || blackKing == pawn ||
+      kingMove(whiteKing).isSet(blackKing) ||
+      (us == Color::white && pawnAttack(pawn, Color::white).isSet(blackKing))) {
+    return KpkResult::invalid;
+  }
+  if (us == Color::white) {
+    Square::t promotion = pawn + Square::north;
+    if (Square::rank(pawn) == Coord::width - 2 && promotion != whiteKing &&
+        promotion != blackKing &&
+        (!kingMove(blackKing).isSet(promotion) ||
+         kingMove(whiteKing).isSet(promotion))) {
+      return KpkResult::win;
+    }
+    return KpkResult::unknown;
+  }
+  if (kingMove(blackKing).isSet(pawn) && !kingMove(whiteKing).isSet(pawn)) {
+    return KpkResult::draw;
+  }
+  BitBoard escapes = kingMove(blackKing) & ~kingMove(whiteKing) &
+                     ~pawnAttack(pawn, Color::white);
+  if (escapes.isEmpty()) {
+    return pawnAttack(pawn, Color::white).isSet(blackKing) ? KpkResult::win
+                                                           : KpkResult::draw;
+  }
+  return KpkResult::unknown;
+}
+
+/// @brief Generates the KPK bitbase by retrograde analysis: starting from
+/// the positions whose result is known right away, positions are resolved
+/// from their successors until nothing changes any more. Whatever is still
+/// unknown then is a draw, as white cannot force any of the known wins.
+/// @param f
+void writeKpkBitbase(std::ostream &f) {
+  vector<KpkResult::t> results(KPK::size);
+  auto forAllPositions = [](auto action) {
+    for (Color::t us : Color::all) {
+      for (Coord::t rank = 1; rank < Coord::width - 1; rank++) {
+        for (Coord::t file = 0; file < Coord::width / 2; file++) {
+          Square::t pawn = Square::index(file, rank);
+          for (auto whiteKing : Square::all) {
+            for (auto blackKing : Square::all) {
+              action(us, whiteKing, pawn, blackKing);
+            }
+          }
+        }
+      }
+    }
+  };
+  forAllPositions([&](Color::t us, Square::t whiteKing, Square::t pawn,
+                      Square::t blackKing) {
+    results[KPK::index(us, whiteKing, pawn, blackKing)] =
+        initialKpkResult(us, whiteKing, pawn, blackKing);
+  });
+  bool changed = true;
+  int passes = 0;
+  while (changed) {
+    changed = false;
+    passes++;
+    forAllPositions([&](Color::t us, Square::t whiteKing, Square::t pawn,
+                        Square::t blackKing) {
+      KpkResult::t &result =
+          results[KPK::index(us, whiteKing, pawn, blackKing)];
+      if (result != KpkResult::unknown) return;
+      result = us == Color::white
+                   ? classifyWhiteToMove(results, whiteKing, pawn, blackKing)
+                   : classifyBlackToMove(results, whiteKing, pawn, blackKing);
+      changed |= result != KpkResult::unknown;
+    });
+  }
+
+  vector<std::uint64_t> wins(KPK::size / 64);
+  std::size_t winCount = 0;
+  for (std::size_t i = 0; i < KPK::size; i++) {
+    if (results[i] == KpkResult::win) {
+      wins[i / 64] |= std::uint64_t{1} << (i % 64);
+      winCount++;
+    }
+  }
+  std::cout << "KPK bitbase: " << winCount << " wins after " << passes
+            << " passes\n";
+
+  f << "namespace Dagor::KPK {\n\n";
+  f << "const std::array<std::uint64_t, size / 64> _wins = {\n";
+  for (std::size_t i = 0; i < wins.size(); i++) {
+    f << wins[i] << "ULL";
+    if (i < wins.size() - 1) f << (i % 4 == 3 ? ",\n" : ", ");
+  }
+  f << "};\n\n";
+  f << "}\n";
 }
 
 int main() {
@@ -480,9 +832,17 @@ int main() {
   writePawnAttacks(f);
   writeKnightMoves(f);
   writeKingMoves(f);
+#ifdef DAGOR_HYPERBOLA
+  writeHyperbolaMasks(f);
+#else
   writeSlidingPieces(f);
+#endif
+  writeLines(f);
 
-  f << "}\n";
+  f << "}\n\n";
+
+  writeZobristKeys(f);
+  writeKpkBitbase(f);
 
   f.close();
   return 0;
@@ -1,9 +1,12 @@
 /// @file main.cpp
 
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <thread>
 
 #include "search.h"
+#include "tablebases.h"
 #include "test.h"
 #include "uci.h"
 
@@ -14,6 +17,25 @@ int main(int argc, char *argv[]) {
     UCI::universalChessInterface(std::cin, std::cout);
   } else if (strcmp(argv[1], "test") == 0) {
     Test::test();
+  } else if (strcmp(argv[1], "bench") == 0) {
+    Test::bench(argc > 2 ? std::atoi(argv[2]) : 5);
+  } else if (strcmp(argv[1], "perft") == 0) {
+    int depth = argc > 2 ? std::atoi(argv[2]) : 4;
+    if (argc > 3) {
+      Test::parallelPerftBench(depth, std::atoi(argv[3]));
+    } else {
+      Test::perftBench(depth);
+    }
+  } else if (strcmp(argv[1], "makemove") == 0) {
+    Test::makeMoveBench(argc > 2 ? std::atoi(argv[2]) : 100'000);
+  } else if (strcmp(argv[1], "gentb") == 0) {
+    unsigned threads = argc > 3 ? std::atoi(argv[3])
+                                : std::thread::hardware_concurrency();
+    if (argc < 3 ||
+        !Tablebases::generate(argv[2], ".", threads, std::cout)) {
+      std::cerr << "usage: gentb <material, e. g. KRvK> [threads]\n";
+      return 1;
+    }
   } else if (strcmp(argv[1], "run") == 0) {
     // GameState s{"2k5/R3P1B1/3P4/3P3P/6Pn/8/2pn4/2K5 w - - 1 44"};
     //  s.executeMove(Move{"e1c1"});
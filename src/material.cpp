@@ -0,0 +1,125 @@
+#include "material.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace Dagor::Eval {
+
+namespace {
+
+/// @brief How much each piece counts towards the game phase: 24 with all
+/// pieces on the board (the midgame), 0 with only pawns and kings left.
+constexpr std::array<int, Piece::all.size()> phaseWeight = {0, 1, 1, 2, 4, 0};
+
+/// @brief The largest count of each piece type in the table, i. e. the
+/// counts without promoted pieces.
+constexpr std::array<int, Piece::nonKing.size()> tableLimit = {8, 2, 2, 2, 1};
+
+constexpr std::size_t tableSize = [] {
+  std::size_t size = 1;
+  for (std::size_t color = 0; color < Color::size; color++) {
+    for (Piece::t piece : Piece::nonKing) {
+      size *= tableLimit[piece] + 1;
+    }
+  }
+  return size;
+}();
+
+/// @return the index of the key in the table, or `tableSize` if a count
+/// exceeds the table's limits.
+std::size_t tableIndex(MaterialKey key) {
+  std::size_t index = 0;
+  for (Color::t color : Color::all) {
+    for (Piece::t piece : Piece::nonKing) {
+      int count = pieceCount(key, piece, color);
+      if (count > tableLimit[piece]) return tableSize;
+      index = index * (tableLimit[piece] + 1) + count;
+    }
+  }
+  return index;
+}
+
+/// @return the material key of the table index, the inverse of `tableIndex`.
+MaterialKey tableKey(std::size_t index) {
+  MaterialKey key = 0;
+  for (int color = Color::size - 1; color >= 0; color--) {
+    for (int piece = Piece::nonKing.size() - 1; piece >= 0; piece--) {
+      std::size_t radix = tableLimit[piece] + 1;
+      key += (index % radix) * materialKey(piece, color);
+      index /= radix;
+    }
+  }
+  return key;
+}
+
+const std::vector<MaterialEntry> materialTable = [] {
+  std::vector<MaterialEntry> table(tableSize);
+  for (std::size_t index = 0; index < tableSize; index++) {
+    table[index] = computeMaterial(tableKey(index));
+  }
+  return table;
+}();
+
+}  // namespace
+
+MaterialEntry computeMaterial(MaterialKey key) {
+  MaterialEntry entry{0, MaterialFlags::none, {fullScale, fullScale}};
+  int phase = 0;
+  std::array<int, Color::size> officers{}, pawns{};
+  for (Color::t color : Color::all) {
+    pawns[color] = pieceCount(key, Piece::pawn, color);
+    for (Piece::t piece : Piece::officers) {
+      int count = pieceCount(key, piece, color);
+      phase += phaseWeight[piece] * count;
+      officers[color] += Piece::worth[piece] * count;
+    }
+  }
+  entry.phase = static_cast<std::uint8_t>(std::min(phase, midgamePhase));
+
+  auto onlyBishops = [key](Color::t color) {
+    for (Piece::t piece : Piece::nonKing) {
+      if (piece != Piece::bishop && pieceCount(key, piece, color) != 0) {
+        return false;
+      }
+    }
+    return true;
+  };
+  if (pawns[Color::white] + pawns[Color::black] == 0) {
+    if (officers[Color::white] + officers[Color::black] <=
+        Piece::worth[Piece::bishop]) {
+      entry.flags |= MaterialFlags::draw;
+    } else if (onlyBishops(Color::white) && onlyBishops(Color::black)) {
+      entry.flags |= MaterialFlags::drawWithSameColoredBishops;
+    }
+  }
+
+  // Without pawns, an advantage of at most a minor piece can rarely be
+  // converted, and never with a minor piece alone. Two knights cannot force
+  // mate either.
+  for (Color::t color : Color::all) {
+    Color::t them = Color::opponent(color);
+    if (pawns[color] != 0) continue;
+    bool twoKnights = officers[color] == 2 * Piece::worth[Piece::knight] &&
+                      pieceCount(key, Piece::knight, color) == 2;
+    if (twoKnights && officers[them] + pawns[them] == 0) {
+      entry.scale[color] = 0;
+    } else if (officers[color] - officers[them] <=
+               Piece::worth[Piece::bishop]) {
+      if (officers[color] < Piece::worth[Piece::rook]) {
+        entry.scale[color] = 0;
+      } else if (officers[them] <= Piece::worth[Piece::bishop]) {
+        entry.scale[color] = fullScale / 16;
+      } else {
+        entry.scale[color] = fullScale / 4;
+      }
+    }
+  }
+  return entry;
+}
+
+MaterialEntry materialEntry(MaterialKey key) {
+  std::size_t index = tableIndex(key);
+  return index < tableSize ? materialTable[index] : computeMaterial(key);
+}
+
+}  // namespace Dagor::Eval
@@ -0,0 +1,75 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <array>
+#include <cstdint>
+
+#include "types.h"
+
+/// @brief What the evaluation derives from the material alone: the game
+/// phase, whether the material is a dead draw, and how much of an advantage
+/// either side can convert.
+namespace Dagor::Eval {
+
+/// @brief The number of pieces of each type and color, four bits each, kings
+/// excluded. As it is a sum, `Position::set` and `Position::unset` update it
+/// by adding and subtracting `materialKey(piece, color)`.
+using MaterialKey = std::uint64_t;
+
+constexpr int materialShift(Piece::t piece, Color::t color) {
+  return 4 * (color * static_cast<int>(Piece::nonKing.size()) + piece);
+}
+
+constexpr MaterialKey materialKey(Piece::t piece, Color::t color) {
+  if (piece == Piece::king) return 0;
+  return MaterialKey{1} << materialShift(piece, color);
+}
+
+constexpr int pieceCount(MaterialKey key, Piece::t piece, Color::t color) {
+  return static_cast<int>((key >> materialShift(piece, color)) & 0xf);
+}
+
+/// @brief The material key with the colors swapped.
+constexpr MaterialKey swapColors(MaterialKey key) {
+  constexpr int shift = materialShift(Piece::pawn, Color::black);
+  constexpr MaterialKey oneColor = (MaterialKey{1} << shift) - 1;
+  return ((key & oneColor) << shift) | ((key >> shift) & oneColor);
+}
+
+namespace MaterialFlags {
+using t = std::uint8_t;
+enum : t {
+  none = 0,
+  /// @brief Neither side can ever mate (KK, KNK, KBK).
+  draw = 1,
+  /// @brief Only bishops are left besides the kings; if they all stand on
+  /// squares of the same color, neither side can ever mate.
+  drawWithSameColoredBishops = 2,
+};
+}  // namespace MaterialFlags
+
+struct MaterialEntry {
+  /// @brief 24 with all pieces on the board (the midgame), 0 with only pawns
+  /// and kings left.
+  std::uint8_t phase;
+  MaterialFlags::t flags;
+  /// @brief By color, the factor (out of `fullScale`) the endgame score is
+  /// scaled by when that color is ahead.
+  std::array<std::uint8_t, Color::size> scale;
+};
+
+constexpr int midgamePhase = 24;
+constexpr int fullScale = 64;
+
+/// @brief Works out the entry of a material key from scratch.
+MaterialEntry computeMaterial(MaterialKey key);
+
+/// @brief The entry of a material key. The entries of all material
+/// combinations without promoted pieces (at most two knights, bishops and
+/// rooks and one queen per side) are computed once at startup and looked up
+/// in a table indexed by the piece counts; others are computed on the fly.
+MaterialEntry materialEntry(MaterialKey key);
+
+}  // namespace Dagor::Eval
+
+#endif
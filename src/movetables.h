@@ -3,6 +3,10 @@
 
 #include <array>
 
+#ifdef DAGOR_PEXT
+#include <immintrin.h>
+#endif
+
 #include "bitboard.h"
 #include "types.h"
 
@@ -32,17 +36,84 @@ inline BitBoards::BitBoard kingMoves(Square::t square) {
   return {_kingMoves[square]};
 }
 
+/// @brief The sliding moves can be looked up in three ways, chosen when
+/// building (`make SLIDERS=...`): with magic hashing (`magic`, the default),
+/// with the BMI2 `pext` instruction (`pext`) or without any tables per
+/// occupancy through hyperbola quintessence (`hyperbola`). Whichever it is,
+/// `bishopMoves` and `rookMoves` give the moves of a bishop or rook on a
+/// square for the given blocking pieces, captures of own pieces included.
+#ifdef DAGOR_HYPERBOLA
+
+/// @brief The lines through each square, without the square itself, that
+/// hyperbola quintessence works on. Access: `_lineMasks[square][line]`.
+extern const std::array<std::array<std::uint64_t, 3>, Square::size>
+    _lineMasks;
+enum LineMask { diagonal, antiDiagonal, file };
+
+/// @brief The attacks of a rook along the first rank. Access:
+/// `_rankAttacks[file][inner]`, where `inner` are the occupied squares b1 to
+/// g1 as six bits.
+extern const std::array<std::array<std::uint8_t, 64>, Coord::width>
+    _rankAttacks;
+
+/// @brief Hyperbola quintessence: the attacks of a slider along one line
+/// through its square, from the difference of the occupancy and the slider
+/// in both directions (the backwards one through the byte swapped board).
+/// This only works for lines that meet every rank at most once.
+inline BitBoards::BitBoard lineAttacks(Square::t square,
+                                       BitBoards::BitBoard occupancy,
+                                       LineMask line) {
+  std::uint64_t mask = _lineMasks[square][line];
+  std::uint64_t forward = occupancy.asUint() & mask;
+  std::uint64_t reverse = __builtin_bswap64(forward);
+  std::uint64_t slider = std::uint64_t{1} << square;
+  forward -= 2 * slider;
+  reverse -= 2 * __builtin_bswap64(slider);
+  return {(forward ^ __builtin_bswap64(reverse)) & mask};
+}
+
+inline BitBoards::BitBoard rankAttacks(Square::t square,
+                                       BitBoards::BitBoard occupancy) {
+  unsigned shift = Square::rank(square) * Coord::width;
+  unsigned inner = (occupancy.asUint() >> (shift + 1)) & 63;
+  return {std::uint64_t{_rankAttacks[Square::file(square)][inner]} << shift};
+}
+
+inline BitBoards::BitBoard bishopMoves(Square::t square,
+                                       BitBoards::BitBoard occupancy) {
+  return lineAttacks(square, occupancy, diagonal) |
+         lineAttacks(square, occupancy, antiDiagonal);
+}
+
+inline BitBoards::BitBoard rookMoves(Square::t square,
+                                     BitBoards::BitBoard occupancy) {
+  return lineAttacks(square, occupancy, file) | rankAttacks(square, occupancy);
+}
+
+#else
+
 /// @brief The move that a sliding piece (bishop, rook or queen) can
 /// make on a given square. Access through the hash functions in
-/// `bishopHashes` and `rookHashes`.
-extern const std::uint64_t slidingMoves[];
+/// `bishopHashes` and `rookHashes`. The tables of the different hash
+/// functions overlap where their entries agree.
+alignas(64) extern const std::uint64_t slidingMoves[];
 
 /// @brief A hash function that maps a configuration of blocking
 /// pieces to an index into the `slidingMoves` table, where the
 /// possible moves of a rook or bishop are stored.
 /// Both rooks and bishops have one separate hash function for each square.
-class BlockerHash {
+/// Everything a look-up needs lies in the same half of a cache line.
+///
+/// Built with `DAGOR_PEXT` (`make SLIDERS=pext`), the hash is the BMI2
+/// parallel bit extract of the blockers under the mask, which is dense by
+/// construction and needs no multiplication; `magic` and `downShift` are
+/// then unused. The tables in `movetables.cpp` are generated for the one or
+/// the other, so they have to be regenerated (`make clean`) when switching.
+class alignas(32) BlockerHash {
  public:
+  /// @brief Where the moves reachable through this hash function begin in
+  /// `slidingMoves`.
+  const std::uint64_t *const moves;
   /// @brief The mask singling out the blocking pieces that actually matter
   /// to the figure under consideration.
   const std::uint64_t blockerMask;
@@ -50,25 +121,22 @@ class BlockerHash {
   const std::uint64_t magic;
   /// @brief The amount by which the hash should be shifted down.
   const unsigned downShift;
-  /// @brief The offset that should be added to the hash. In `slidingMoves` all
-  /// entries lie consecutively, this marks where the entries begin, that can be
-  /// accessed through this hash function.
-  const unsigned tableOffset;
-
-  BlockerHash(std::uint64_t mask, std::uint64_t magic, unsigned downShift,
-              unsigned tableOffset)
-      : blockerMask{mask},
-        magic{magic},
-        downShift{downShift},
-        tableOffset{tableOffset} {}
+
+  constexpr BlockerHash(const std::uint64_t *moves, std::uint64_t mask,
+                        std::uint64_t magic, unsigned downShift)
+      : moves{moves}, blockerMask{mask}, magic{magic}, downShift{downShift} {}
 
   /// @brief Computes the hash for a configuration of blocking pieces.
   /// @param blockers pieces blocking the bishop’s/rook’s movement.
-  /// @return the hash.
+  /// @return the hash, an index into `moves`.
   unsigned hash(BitBoards::BitBoard blockers) const {
+#ifdef DAGOR_PEXT
+    return static_cast<unsigned>(_pext_u64(blockers.asUint(), blockerMask));
+#else
     blockers &= blockerMask;
     std::uint64_t h = blockers.asUint() * magic;
-    return static_cast<unsigned>(h >> downShift) + tableOffset;
+    return static_cast<unsigned>(h >> downShift);
+#endif
   }
 
   /// @brief Looks up the possible moves for a bishop/rook with the
@@ -77,14 +145,135 @@ class BlockerHash {
   /// @return a bitboard where all squares, to which the bishop/rook can move,
   /// are set.
   BitBoards::BitBoard lookUp(BitBoards::BitBoard blockers) const {
-    return {slidingMoves[hash(blockers)]};
+    return {moves[hash(blockers)]};
   }
 };
 
+static_assert(sizeof(BlockerHash) == 32,
+              "Two hash functions should share one cache line.");
+
 /// @brief the hash functions to look up bishop moves, by square.
-extern const std::array<BlockerHash, Square::size> bishopHashes;
+alignas(64) extern const std::array<BlockerHash, Square::size> bishopHashes;
 /// @brief the hash function to look up rook moves, by square.
-extern const std::array<BlockerHash, Square::size> rookHashes;
+alignas(64) extern const std::array<BlockerHash, Square::size> rookHashes;
+
+inline BitBoards::BitBoard bishopMoves(Square::t square,
+                                       BitBoards::BitBoard occupancy) {
+  return bishopHashes[square].lookUp(occupancy);
+}
+
+inline BitBoards::BitBoard rookMoves(Square::t square,
+                                     BitBoards::BitBoard occupancy) {
+  return rookHashes[square].lookUp(occupancy);
+}
+
+#endif
+
+/// @brief The squares strictly between two squares on a common rank, file or
+/// diagonal. Access: `_between[a][b]`.
+extern const std::array<std::array<std::uint64_t, Square::size>, Square::size>
+    _between;
+
+inline BitBoards::BitBoard between(Square::t a, Square::t b) {
+  return {_between[a][b]};
+}
+
+/// @brief The whole rank, file or diagonal through two squares, from edge to
+/// edge, or the empty bitboard if the squares are not aligned. Access:
+/// `_lines[a][b]`.
+extern const std::array<std::array<std::uint64_t, Square::size>, Square::size>
+    _lines;
+
+inline BitBoards::BitBoard line(Square::t a, Square::t b) {
+  return {_lines[a][b]};
+}
 }  // namespace Dagor::MoveTables
 
+/// @brief The random numbers for Zobrist hashing. A position’s hash is the xor
+/// of the keys of all its pieces, its castling rights, its en passant file and
+/// the side to move, so that it can be updated incrementally.
+namespace Dagor::Zobrist {
+
+/// @brief Access: `_pieces[color * 6 + piece][square]`.
+extern const std::array<std::array<std::uint64_t, Square::size>,
+                        Color::size * Piece::all.size()>
+    _pieces;
+
+inline std::uint64_t piece(Piece::t piece, Color::t color, Square::t square) {
+  return _pieces[color * Piece::all.size() + piece][square];
+}
+
+/// @brief One key per combination of castling rights; no rights have the key
+/// `0`.
+extern const std::array<std::uint64_t, CastlingRights::fullRights + 1>
+    _castling;
+
+inline std::uint64_t castling(CastlingRights::t rights) {
+  return _castling[rights];
+}
+
+/// @brief One key per file of the en passant square.
+extern const std::array<std::uint64_t, Coord::width> _enPassant;
+
+inline std::uint64_t enPassant(Square::t square) {
+  return _enPassant[Square::file(square)];
+}
+
+extern const std::uint64_t blackToMove;
+
+}  // namespace Dagor::Zobrist
+
+/// @brief The bitbase of king and pawn against king: for every such position,
+/// one bit whether the side with the pawn wins. It is generated by
+/// retrograde analysis in `generate_movetables.cpp` and only stores the
+/// positions where white has the pawn and it stands on the files a to d;
+/// `probe` mirrors the others onto these.
+namespace Dagor::KPK {
+
+/// @brief The squares a pawn can stand on in the bitbase: files a to d,
+/// ranks 2 to 7.
+constexpr int pawnSquares = (Coord::width / 2) * (Coord::width - 2);
+
+constexpr std::size_t size =
+    Color::size * pawnSquares * Square::size * Square::size;
+
+/// @brief One bit per position, set if white wins. Access through `index`.
+extern const std::array<std::uint64_t, size / 64> _wins;
+
+/// @param us the side to move.
+/// @param pawn the white pawn, on the files a to d.
+constexpr std::size_t index(Color::t us, Square::t whiteKing, Square::t pawn,
+                            Square::t blackKing) {
+  int pawnIndex =
+      (Square::rank(pawn) - 1) * (Coord::width / 2) + Square::file(pawn);
+  return ((static_cast<std::size_t>(us) * pawnSquares + pawnIndex) *
+              Square::size +
+          whiteKing) *
+             Square::size +
+         blackKing;
+}
+
+/// @brief Whether the side with the pawn wins.
+/// @param strong the color of the side with the pawn.
+/// @param us the side to move.
+inline bool probe(Color::t strong, Color::t us, Square::t strongKing,
+                  Square::t pawn, Square::t weakKing) {
+  if (strong == Color::black) {
+    strongKing = Square::reverseForColor(strongKing, Color::black);
+    pawn = Square::reverseForColor(pawn, Color::black);
+    weakKing = Square::reverseForColor(weakKing, Color::black);
+    us = Color::opponent(us);
+  }
+  if (Square::file(pawn) >= Coord::width / 2) {
+    // mirror the files
+    strongKing ^= Coord::width - 1;
+    pawn ^= Coord::width - 1;
+    weakKing ^= Coord::width - 1;
+  }
+  std::size_t i = index(us, strongKing, pawn, weakKing);
+  return (_wins[i / 64] >> (i % 64)) & 1;
+}
+
+}  // namespace Dagor::KPK
+
 #endif
\ No newline at end of file
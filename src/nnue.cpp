@@ -0,0 +1,276 @@
+#include "nnue.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+#include "game_state.h"
+#include "psqt.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace Dagor::NNUE {
+
+namespace {
+
+constexpr std::size_t headerSize = 64;
+constexpr char magic[] = "Dagor-in-Erain NNUE 1";
+
+static_assert(sizeof(Network) % 64 == 0,
+              "The parameters of a mapped file must stay aligned.");
+
+/// @brief The input neuron `k` of the built-in network sees the value of
+/// the position (in units of `step` centipawns) shifted by `-offset(k)`.
+/// Clipped, each neuron covers a different range of `activationMax` units,
+/// so that their sum is the value again, plus a constant.
+constexpr int step = 2;
+constexpr int offset(int k) { return activationMax * (k - l1 / 2); }
+
+std::unique_ptr<Network> buildDefaultNetwork() {
+  auto net = std::make_unique<Network>();
+  for (Piece::t piece : Piece::all) {
+    for (Square::t square = 0; square < Square::size; square++) {
+      for (Color::t color : Color::all) {
+        // from white’s perspective, where the feature index and the score
+        // need no mirroring
+        Eval::Score score = Eval::pieceSquare(piece, color, square);
+        int value = (Eval::midgame(score) + Eval::endgame(score)) / 2;
+        int input = featureIndex(Color::white, {piece, color, square});
+        for (int k = 0; k < l1; k++) {
+          net->featureWeights[input * l1 + k] =
+              static_cast<std::int16_t>(value / step);
+        }
+      }
+    }
+  }
+  for (int k = 0; k < l1; k++) {
+    net->featureBiases[k] = static_cast<std::int16_t>(-offset(k));
+  }
+  // the hidden layer passes the side to move’s neurons through unchanged
+  net->hiddenWeights.fill(0);
+  net->hiddenBiases.fill(0);
+  for (int k = 0; k < l2 && k < l1; k++) {
+    net->hiddenWeights[k * 2 * l1 + k] = 1 << hiddenShift;
+  }
+  net->outputWeights.fill(step * outputDivisor);
+  net->outputBias = step * outputDivisor * offset(0);
+  return net;
+}
+
+const Network *current = nullptr;
+bool useNetwork = false;
+
+/// @brief The mapping of the file loaded last.
+void *mapped = nullptr;
+std::size_t mappedSize = 0;
+
+void unmap() {
+  if (mapped != nullptr) {
+    munmap(mapped, mappedSize);
+    mapped = nullptr;
+  }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2"))) void hiddenLayerAvx2(
+    const Network &net, const std::array<std::uint8_t, 2 * l1> &input,
+    std::array<std::int32_t, l2> &output) {
+  static_assert(2 * l1 == 64, "The kernel reads the input in two halves.");
+  const __m256i ones = _mm256_set1_epi16(1);
+  auto in = reinterpret_cast<const __m256i *>(input.data());
+  __m256i low = _mm256_loadu_si256(in);
+  __m256i high = _mm256_loadu_si256(in + 1);
+  for (int i = 0; i < l2; i++) {
+    auto w = reinterpret_cast<const __m256i *>(&net.hiddenWeights[i * 2 * l1]);
+    // u8 * s8 products, added pairwise to int16 (127 * 127 * 2 fits)
+    __m256i sum = _mm256_madd_epi16(
+        _mm256_maddubs_epi16(low, _mm256_load_si256(w)), ones);
+    sum = _mm256_add_epi32(
+        sum, _mm256_madd_epi16(
+                 _mm256_maddubs_epi16(high, _mm256_load_si256(w + 1)), ones));
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                                 _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xb1));
+    output[i] = net.hiddenBiases[i] + _mm_cvtsi128_si32(half);
+  }
+}
+
+__attribute__((target("ssse3"))) void hiddenLayerSsse3(
+    const Network &net, const std::array<std::uint8_t, 2 * l1> &input,
+    std::array<std::int32_t, l2> &output) {
+  const __m128i ones = _mm_set1_epi16(1);
+  auto in = reinterpret_cast<const __m128i *>(input.data());
+  for (int i = 0; i < l2; i++) {
+    auto w = reinterpret_cast<const __m128i *>(&net.hiddenWeights[i * 2 * l1]);
+    __m128i sum = _mm_setzero_si128();
+    for (int chunk = 0; chunk < 2 * l1 / 16; chunk++) {
+      sum = _mm_add_epi32(
+          sum, _mm_madd_epi16(_mm_maddubs_epi16(_mm_loadu_si128(in + chunk),
+                                                _mm_load_si128(w + chunk)),
+                              ones));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+    output[i] = net.hiddenBiases[i] + _mm_cvtsi128_si32(sum);
+  }
+}
+#endif
+
+using HiddenLayer = void (*)(const Network &,
+                             const std::array<std::uint8_t, 2 * l1> &,
+                             std::array<std::int32_t, l2> &);
+
+HiddenLayer selectHiddenLayer() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    return hiddenLayerAvx2;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return hiddenLayerSsse3;
+  }
+#endif
+  return hiddenLayerScalar;
+}
+
+const HiddenLayer dispatchedHiddenLayer = selectHiddenLayer();
+
+}  // namespace
+
+bool enabled() { return useNetwork; }
+void enable(bool on) { useNetwork = on; }
+
+const Network &defaultNetwork() {
+  static const std::unique_ptr<Network> net = buildDefaultNetwork();
+  return *net;
+}
+
+const Network &network() {
+  return current != nullptr ? *current : defaultNetwork();
+}
+
+bool load(const std::string &path) {
+  int file = open(path.c_str(), O_RDONLY);
+  if (file < 0) {
+    return false;
+  }
+  struct stat info {};
+  void *memory = MAP_FAILED;
+  std::size_t size = headerSize + sizeof(Network);
+  if (fstat(file, &info) == 0 &&
+      static_cast<std::size_t>(info.st_size) == size) {
+    memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+  }
+  close(file);
+  if (memory == MAP_FAILED) {
+    return false;
+  }
+  if (std::memcmp(memory, magic, sizeof(magic)) != 0) {
+    munmap(memory, size);
+    return false;
+  }
+  unmap();
+  mapped = memory;
+  mappedSize = size;
+  current = reinterpret_cast<const Network *>(static_cast<char *>(memory) +
+                                              headerSize);
+  return true;
+}
+
+void useDefault() {
+  current = nullptr;
+  unmap();
+}
+
+bool save(const std::string &path) {
+  std::ofstream out{path, std::ios::binary};
+  std::array<char, headerSize> header{};
+  std::copy(std::begin(magic), std::end(magic), header.begin());
+  out.write(header.data(), header.size());
+  out.write(reinterpret_cast<const char *>(&network()), sizeof(Network));
+  return static_cast<bool>(out);
+}
+
+void refresh(const Position &position, Accumulator &accumulator) {
+  const Network &net = network();
+  for (Color::t perspective : Color::all) {
+    auto &values = accumulator.values[perspective];
+    std::copy(net.featureBiases.begin(), net.featureBiases.end(),
+              values.begin());
+    for (Square::t square : position.occupancy()) {
+      int input = featureIndex(perspective, {position.getPiece(square),
+                                             position.getColor(square),
+                                             square});
+      for (int i = 0; i < l1; i++) {
+        values[i] += net.featureWeights[input * l1 + i];
+      }
+    }
+  }
+}
+
+void update(const Accumulator &from, Accumulator &to,
+            const FeatureChanges &changes) {
+  const Network &net = network();
+  for (Color::t perspective : Color::all) {
+    auto &values = to.values[perspective];
+    values = from.values[perspective];
+    for (int c = 0; c < changes.addedCount; c++) {
+      const std::int16_t *weights =
+          &net.featureWeights[featureIndex(perspective, changes.added[c]) * l1];
+      for (int i = 0; i < l1; i++) values[i] += weights[i];
+    }
+    for (int c = 0; c < changes.removedCount; c++) {
+      const std::int16_t *weights =
+          &net.featureWeights[featureIndex(perspective, changes.removed[c]) *
+                              l1];
+      for (int i = 0; i < l1; i++) values[i] -= weights[i];
+    }
+  }
+}
+
+int evaluate(const Accumulator &accumulator, Color::t us) {
+  const Network &net = network();
+  alignas(64) std::array<std::uint8_t, 2 * l1> input;
+  for (int i = 0; i < l1; i++) {
+    input[i] = static_cast<std::uint8_t>(
+        std::clamp<int>(accumulator.values[us][i], 0, activationMax));
+    input[l1 + i] = static_cast<std::uint8_t>(std::clamp<int>(
+        accumulator.values[Color::opponent(us)][i], 0, activationMax));
+  }
+  std::array<std::int32_t, l2> hidden;
+  hiddenLayer(net, input, hidden);
+  std::int32_t output = net.outputBias;
+  for (int i = 0; i < l2; i++) {
+    output += net.outputWeights[i] *
+              std::clamp(hidden[i] >> hiddenShift, 0, activationMax);
+  }
+  return output / outputDivisor;
+}
+
+void hiddenLayerScalar(const Network &net,
+                       const std::array<std::uint8_t, 2 * l1> &input,
+                       std::array<std::int32_t, l2> &output) {
+  for (int i = 0; i < l2; i++) {
+    std::int32_t sum = net.hiddenBiases[i];
+    for (int j = 0; j < 2 * l1; j++) {
+      sum += net.hiddenWeights[i * 2 * l1 + j] * input[j];
+    }
+    output[i] = sum;
+  }
+}
+
+void hiddenLayer(const Network &net,
+                 const std::array<std::uint8_t, 2 * l1> &input,
+                 std::array<std::int32_t, l2> &output) {
+  dispatchedHiddenLayer(net, input, output);
+}
+
+}  // namespace Dagor::NNUE
@@ -0,0 +1,133 @@
+#ifndef NNUE_H
+#define NNUE_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "types.h"
+
+namespace Dagor {
+class Position;
+}
+
+/// @brief An efficiently updatable neural network (NNUE) for the evaluation.
+///
+/// The inputs are the 768 combinations of piece type, color and square, seen
+/// from one side (the perspective): first the own pieces, then the
+/// opponent’s, with the board mirrored for black. The feature transformer
+/// maps them to `l1` int16 values per perspective, the accumulator. As a
+/// move only changes a few inputs, the accumulator is updated incrementally
+/// (see `GameState::executeMove`). The clipped accumulators of the side to
+/// move and of the opponent feed a hidden layer of `l2` neurons with int8
+/// weights, whose clipped outputs give the evaluation.
+///
+/// No trained network comes with the engine: the built-in one only mirrors
+/// the classical evaluation (see `defaultNetwork`), and the network is off
+/// unless enabled with `UseNNUE`. A trained one is loaded with `EvalFile`.
+namespace Dagor::NNUE {
+
+constexpr int inputs = 2 * Piece::all.size() * Square::size;
+/// @brief The width of the accumulator of one perspective.
+constexpr int l1 = 32;
+/// @brief The width of the hidden layer.
+constexpr int l2 = 32;
+/// @brief Activations are clipped to `[0, activationMax]`.
+constexpr int activationMax = 127;
+/// @brief The hidden layer’s sums are shifted right by this before clipping.
+constexpr int hiddenShift = 6;
+/// @brief The output layer’s sum divided by this is the evaluation in
+/// centipawns.
+constexpr int outputDivisor = 16;
+
+/// @brief The quantized parameters. A network file is a 64 byte header
+/// followed by this struct as it lies in memory, so that a mapped file can
+/// be used without copying.
+struct Network {
+  /// @brief Access: `featureWeights[input * l1 + i]`.
+  alignas(64) std::array<std::int16_t, inputs * l1> featureWeights;
+  alignas(64) std::array<std::int16_t, l1> featureBiases;
+  /// @brief Access: `hiddenWeights[neuron * 2 * l1 + input]`, where the
+  /// inputs are the side to move’s accumulator, then the opponent’s.
+  alignas(64) std::array<std::int8_t, l2 * 2 * l1> hiddenWeights;
+  alignas(64) std::array<std::int32_t, l2> hiddenBiases;
+  alignas(64) std::array<std::int8_t, l2> outputWeights;
+  std::int32_t outputBias;
+};
+
+/// @brief The first layer’s values of a position, by perspective.
+struct alignas(64) Accumulator {
+  std::array<std::array<std::int16_t, l1>, Color::size> values;
+};
+
+/// @brief A piece that is added to or removed from a square.
+struct Feature {
+  Piece::t piece;
+  Color::t color;
+  Square::t square;
+};
+
+/// @brief The inputs a move switches on and off. Castling moves two pieces,
+/// a capturing promotion removes two and adds one.
+struct FeatureChanges {
+  std::array<Feature, 2> added{};
+  std::array<Feature, 2> removed{};
+  std::uint8_t addedCount = 0;
+  std::uint8_t removedCount = 0;
+
+  void add(Piece::t piece, Color::t color, Square::t square) {
+    added[addedCount++] = {piece, color, square};
+  }
+  void remove(Piece::t piece, Color::t color, Square::t square) {
+    removed[removedCount++] = {piece, color, square};
+  }
+};
+
+/// @return the index of an input from the given perspective.
+constexpr int featureIndex(Color::t perspective, Feature feature) {
+  int side = feature.color == perspective ? 0 : 1;
+  return ((side * Piece::all.size() + feature.piece) * Square::size) +
+         Square::reverseForColor(feature.square, perspective);
+}
+
+/// @brief Whether `Eval::eval` uses the network (UCI option `UseNNUE`).
+bool enabled();
+void enable(bool on);
+
+/// @brief The network in use: the built-in one, unless another was loaded.
+const Network &network();
+/// @brief The built-in network. It has not been trained, but reproduces the
+/// classical material and piece-square evaluation, with the midgame and
+/// endgame values averaged.
+const Network &defaultNetwork();
+/// @brief Maps a network file into memory and uses it (UCI option
+/// `EvalFile`). The previously loaded file, if any, is unmapped.
+/// @return false, and the network in use is kept, if the file cannot be
+/// read or is no network file of this version.
+bool load(const std::string &path);
+/// @brief Switches back to the built-in network.
+void useDefault();
+/// @brief Writes the network in use to a file that `load` accepts.
+bool save(const std::string &path);
+
+void refresh(const Position &position, Accumulator &accumulator);
+/// @brief Computes `to` from the accumulator of the position before a move.
+void update(const Accumulator &from, Accumulator &to,
+            const FeatureChanges &changes);
+/// @return the evaluation in centipawns from the side to move’s point of
+/// view.
+int evaluate(const Accumulator &accumulator, Color::t us);
+
+/// @brief The hidden layer: `output[i]` is the i-th bias plus the weighted
+/// sum of `input`. `hiddenLayer` dispatches at runtime to an AVX2, SSSE3 or
+/// this scalar implementation.
+void hiddenLayerScalar(const Network &net,
+                       const std::array<std::uint8_t, 2 * l1> &input,
+                       std::array<std::int32_t, l2> &output);
+void hiddenLayer(const Network &net,
+                 const std::array<std::uint8_t, 2 * l1> &input,
+                 std::array<std::int32_t, l2> &output);
+
+}  // namespace Dagor::NNUE
+
+#endif
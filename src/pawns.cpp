@@ -0,0 +1,99 @@
+#include "pawns.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace Dagor::Eval {
+
+static_assert(sizeof(PawnEntry) == 64,
+              "A pawn entry should fill a cache line.");
+
+namespace {
+
+constexpr Score doubled = makeScore(-10, -20);
+constexpr Score isolated = makeScore(-10, -15);
+constexpr Score backward = makeScore(-8, -12);
+
+/// @brief By relative rank.
+constexpr std::array<Score, Coord::width> passedBonus = {
+    makeScore(0, 0),   makeScore(5, 10),  makeScore(10, 15),
+    makeScore(15, 25), makeScore(25, 45), makeScore(45, 75),
+    makeScore(70, 120), makeScore(0, 0)};
+
+/// @brief By the distance in ranks of the nearest own pawn in front of the
+/// king on a file, 0 if there is none.
+constexpr std::array<int, Coord::width> shelterBonus = {-25, 20, 10, 5,
+                                                        0,   0,  0,  0};
+
+BitBoards::BitBoard adjacentFiles(Coord::t file) {
+  BitBoards::BitBoard files{};
+  if (file > 0) files |= BitBoards::wholeFile(file - 1);
+  if (file < Coord::width - 1) files |= BitBoards::wholeFile(file + 1);
+  return files;
+}
+
+}  // namespace
+
+Score PawnEntry::computeShelter(const Position &position, Color::t color,
+                                Square::t king) {
+  BitBoards::BitBoard ours = position.forPiece(Piece::pawn, color);
+  BitBoards::BitBoard front = forwardRanks(color, Square::rank(king));
+  Coord::t kingFile = Square::file(king);
+  int bonus = 0;
+  for (int file = std::max(kingFile - 1, 0);
+       file <= std::min(kingFile + 1, Coord::width - 1); file++) {
+    BitBoards::BitBoard shield = ours & front & BitBoards::wholeFile(file);
+    int distance = 0;
+    if (!shield.isEmpty()) {
+      Square::t nearest = color == Color::white ? shield.findFirstSet()
+                                                : shield.findLastSet();
+      distance = std::abs(Square::rank(nearest) - Square::rank(king));
+    }
+    bonus += shelterBonus[distance];
+  }
+  return makeScore(bonus, 0);
+}
+
+PawnEntry evaluatePawns(const Position &position) {
+  PawnEntry entry{};
+  entry.key = position.pawnKey;
+  for (Color::t color : Color::all) {
+    entry.attacks[color] =
+        BitBoards::pawnAttacks(position.forPiece(Piece::pawn, color), color);
+  }
+  for (Color::t color : Color::all) {
+    Color::t them = Color::opponent(color);
+    BitBoards::BitBoard ours = position.forPiece(Piece::pawn, color);
+    BitBoards::BitBoard theirs = position.forPiece(Piece::pawn, them);
+    int up = color == Color::white ? Square::north : Square::south;
+    Score score = 0;
+    for (Square::t square : ours) {
+      Coord::t file = Square::file(square);
+      BitBoards::BitBoard front = forwardRanks(color, Square::rank(square));
+      BitBoards::BitBoard neighbours = adjacentFiles(file);
+      if ((theirs & front & (neighbours | BitBoards::wholeFile(file)))
+              .isEmpty()) {
+        entry.passed[color].setSquare(square);
+        Coord::t rank = Square::rank(Square::reverseForColor(square, color));
+        score += passedBonus[rank];
+      }
+      if (!(ours & front & BitBoards::wholeFile(file)).isEmpty()) {
+        score += doubled;
+      }
+      if ((ours & neighbours).isEmpty()) {
+        score += isolated;
+      } else if ((ours & neighbours & ~front).isEmpty() &&
+                 entry.attacks[them].isSet(square + up)) {
+        // no neighbour can come up to defend it, and it cannot advance
+        score += backward;
+      }
+    }
+    entry.score += color == Color::white ? score : -score;
+  }
+  return entry;
+}
+
+PawnTable::PawnTable(std::size_t size)
+    : entries(size), probeCount{0}, hitCount{0} {}
+
+}  // namespace Dagor::Eval
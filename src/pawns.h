@@ -0,0 +1,97 @@
+#ifndef PAWNS_H
+#define PAWNS_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "bitboard.h"
+#include "game_state.h"
+#include "psqt.h"
+#include "types.h"
+
+namespace Dagor::Eval {
+
+/// @brief The squares of the ranks in front of `rank` as seen by `color`.
+inline BitBoards::BitBoard forwardRanks(Color::t color, Coord::t rank) {
+  return color == Color::white ? BitBoards::above(rank)
+                               : BitBoards::below(rank);
+}
+
+/// @brief What the evaluation knows about a pawn structure. It only depends
+/// on the pawns (and is therefore cached by `Position::pawnKey`), except for
+/// the king shelters, which are worked out for the king squares they were
+/// last asked for.
+struct PawnEntry {
+  std::uint64_t key = 0;
+  /// @brief The passed, isolated, doubled and backward pawns from white’s
+  /// point of view.
+  Score score = 0;
+  /// @brief By color, the squares attacked by that color’s pawns.
+  std::array<BitBoards::BitBoard, Color::size> attacks{};
+  /// @brief By color, that color’s passed pawns.
+  std::array<BitBoards::BitBoard, Color::size> passed{};
+  std::array<Square::t, Color::size> kingSquares = {Square::noSquare,
+                                                    Square::noSquare};
+  std::array<Score, Color::size> shelters = {0, 0};
+
+  /// @brief The shelter of the own pawns in front of a color’s king.
+  Score shelter(const Position &position, Color::t color) {
+    BitBoards::BitBoard kings = position.forPiece(Piece::king, color);
+    if (kings.isEmpty()) return 0;
+    Square::t king = kings.findFirstSet();
+    if (kingSquares[color] != king) {
+      kingSquares[color] = king;
+      shelters[color] = computeShelter(position, color, king);
+    }
+    return shelters[color];
+  }
+
+  static Score computeShelter(const Position &position, Color::t color,
+                              Square::t king);
+};
+
+/// @brief Evaluates the pawn structure of a position from scratch.
+PawnEntry evaluatePawns(const Position &position);
+
+/// @brief A hash table of pawn structures, indexed by the pawn key. Pawn
+/// structures change much more rarely than positions, so that almost every
+/// evaluation in a search finds its structure here. Each search thread owns
+/// one; all memory is allocated in the constructor.
+class PawnTable {
+ private:
+  std::vector<PawnEntry> entries;
+  std::uint64_t probeCount;
+  std::uint64_t hitCount;
+
+ public:
+  /// @brief The default number of entries (64 bytes each).
+  static constexpr std::size_t defaultSize = 1 << 13;
+
+  /// @param size the number of entries; a power of two.
+  explicit PawnTable(std::size_t size = defaultSize);
+
+  /// @brief The entry of the position’s pawn structure, evaluated first if
+  /// it is not in the table yet.
+  PawnEntry &probe(const Position &position) {
+    probeCount++;
+    PawnEntry &entry = entries[position.pawnKey & (entries.size() - 1)];
+    if (entry.key == position.pawnKey) {
+      hitCount++;
+    } else {
+      entry = evaluatePawns(position);
+    }
+    return entry;
+  }
+
+  std::uint64_t probes() const { return probeCount; }
+  std::uint64_t hits() const { return hitCount; }
+  void resetStatistics() {
+    probeCount = 0;
+    hitCount = 0;
+  }
+};
+
+}  // namespace Dagor::Eval
+
+#endif
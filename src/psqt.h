@@ -0,0 +1,45 @@
+#ifndef PSQT_H
+#define PSQT_H
+
+#include <array>
+#include <cstdint>
+
+#include "types.h"
+
+namespace Dagor::Eval {
+
+/// @brief A midgame and an endgame value packed into one integer, so that
+/// both are updated with a single addition. The endgame value is in the
+/// upper 16 bits, the midgame value in the lower; adding and subtracting
+/// scores carries between the halves just like adding the values would.
+using Score = std::int32_t;
+
+constexpr Score makeScore(int midgame, int endgame) {
+  return static_cast<Score>(static_cast<std::uint32_t>(endgame) << 16) +
+         midgame;
+}
+
+constexpr int midgame(Score score) {
+  return static_cast<std::int16_t>(
+      static_cast<std::uint16_t>(static_cast<std::uint32_t>(score)));
+}
+
+constexpr int endgame(Score score) {
+  return static_cast<std::int16_t>(static_cast<std::uint16_t>(
+      static_cast<std::uint32_t>(score + 0x8000) >> 16));
+}
+
+/// @brief The material and piece-square scores from white’s point of view.
+/// Access: `pieceSquareScores[color][piece][square]`.
+extern const std::array<
+    std::array<std::array<Score, Square::size>, Piece::all.size()>,
+    Color::size>
+    pieceSquareScores;
+
+inline Score pieceSquare(Piece::t piece, Color::t color, Square::t square) {
+  return pieceSquareScores[color][piece][square];
+}
+
+}  // namespace Dagor::Eval
+
+#endif
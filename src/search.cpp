@@ -5,18 +5,11 @@
 #include <random>
 
 #include "eval.h"
+#include "nnue.h"
+#include "tablebases.h"
 
 namespace Dagor::Search {
 
-std::vector<Move> orderedMoves(const GameState& state) {
-  auto moves = state.generateLegalMoves();
-  auto sorter = [&state](Move a, Move b) {
-    return state.getPiece(a.end) < state.getPiece(b.end);
-  };
-  std::sort(moves.begin(), moves.end(), sorter);
-  return moves;
-}
-
 Move random(const GameState& state) {
   auto moves = state.generateLegalMoves();
   std::random_device rd;
@@ -29,49 +22,306 @@ Move random(const GameState& state) {
 
 constexpr int INF = std::numeric_limits<int>::max();
 
-int negatedMax(GameState& state, int depth, int alpha, int beta) {
-  if (depth == 0) {
-    return Eval::eval(state);
-  }
+/// @brief The score of a position the tablebases call won, less the plies to
+/// mate where the tables store them (else the plies to the table), so that
+/// the search prefers the sooner of two wins. It lies above any evaluation
+/// and below the mate scores.
+constexpr int tablebaseWin = 20000;
+
+RootMove::RootMove(Move move) : move{move}, score{-INF}, pv() {
+  pv.assign(move, Line{});
+}
 
-  auto moves = orderedMoves(state);
-  if (moves.empty()) {
-    if (state.isCheck()) {
-      return -INF;
+/// @brief Scores the moves of a frame for move ordering: captures first, the
+/// most valuable victim first and among those the least valuable attacker,
+/// then the killer moves, then all other moves.
+void scoreMoves(const GameState& state, Frame& frame) {
+  for (std::size_t i = 0; i < frame.moves.size(); i++) {
+    Move m = frame.moves[i];
+    Piece::t victim = state.getPiece(m.end());
+    if (victim != Piece::empty) {
+      frame.scores[i] = 8 + 8 * victim - state.getPiece(m.start());
+    } else if (m == frame.killers[0]) {
+      frame.scores[i] = 2;
+    } else if (m == frame.killers[1]) {
+      frame.scores[i] = 1;
     } else {
-      return 0;
+      frame.scores[i] = 0;
     }
   }
+}
+
+/// @brief Moves the best scored of the moves `i, i + 1, ...` to index `i`.
+Move pickMove(Frame& frame, std::size_t i) {
+  std::size_t best = i;
+  for (std::size_t j = i + 1; j < frame.moves.size(); j++) {
+    if (frame.scores[j] > frame.scores[best]) best = j;
+  }
+  std::swap(frame.moves[i], frame.moves[best]);
+  std::swap(frame.scores[i], frame.scores[best]);
+  return frame.moves[i];
+}
 
-  for (Move m : moves) {
+void storeKiller(const GameState& state, Frame& frame, Move move) {
+  bool quiet = state.getPiece(move.end()) == Piece::empty;
+  if (quiet && !(move == frame.killers[0])) {
+    frame.killers[1] = frame.killers[0];
+    frame.killers[0] = move;
+  }
+}
+
+Searcher::Searcher()
+    : stack(maxPly + 1),
+      accumulators(maxPly + 1),
+      rootMoves(),
+      nodeCount{0},
+      tablebaseHits{0},
+      pawnTable(),
+      evalCache() {
+  rootMoves.reserve(MoveList::capacity);
+}
+
+int Searcher::negatedMax(GameState& state, int ply, int depth, int alpha,
+                         int beta) {
+  if (Eval::isDeadDraw(state)) {
+    nodeCount++;
+    return 0;
+  }
+  // Right after a capture or a pawn move, as the tables do not know the
+  // fifty-move rule.
+  if (state.uneventfulHalfMoves == 0 &&
+      state.occupancy().populationCount() <= Tablebases::largest()) {
+    if (auto result = Tablebases::probeWDL(state)) {
+      nodeCount++;
+      tablebaseHits++;
+      int distance = ply;
+      if (*result != Tablebases::WDL::draw) {
+        if (auto plies = Tablebases::probeDTM(state)) {
+          distance += std::abs(*plies);
+        }
+      }
+      return *result * (tablebaseWin - distance);
+    }
+  }
+  if (depth == 0) {
+    return quiescence(state, ply, alpha, beta);
+  }
+  nodeCount++;
+  Frame& frame = stack[ply];
+  frame.pv.length = 0;
+
+  // Legality is only checked for the moves that are actually searched, so
+  // that the moves after a cutoff never pay for it.
+  state.generatePseudoLegalMoves<GenerationMode::all>(frame.moves);
+  int legalMoves = 0;
+
+  scoreMoves(state, frame);
+  for (std::size_t i = 0; i < frame.moves.size(); i++) {
+    Move m = pickMove(frame, i);
+    if (!state.isLegal(m)) continue;
+    legalMoves++;
     state.executeMove(m);
-    int eval = -negatedMax(state, depth - 1, -beta, -alpha);
-    state.undoMove();
+    int eval = -negatedMax(state, ply + 1, depth - 1, -beta, -alpha);
+    state.undoMove(m);
     if (eval >= beta) {
       // Move is too good, opponent will have made a different choice earlier
+      storeKiller(state, frame, m);
       return beta;
     }
-    alpha = std::max(alpha, eval);
+    if (eval > alpha) {
+      alpha = eval;
+      frame.pv.assign(m, stack[ply + 1].pv);
+    }
+  }
+  if (legalMoves == 0) {
+    return state.isCheck() ? -INF : 0;
   }
   return alpha;
 }
 
-Move negatedMaxSearch(GameState& state) {
-  auto moves = state.generateLegalMoves();
-  Move bestMove = moves.front();
-  int bestScore = std::numeric_limits<int>::min();
-  for (Move m : moves) {
+/// @brief Searches only captures and promotions (or all evasions when in
+/// check) until the position is quiet, so that the static evaluation is not
+/// taken in the middle of an exchange.
+int Searcher::quiescence(GameState& state, int ply, int alpha, int beta) {
+  nodeCount++;
+  Frame& frame = stack[ply];
+  frame.pv.length = 0;
+  bool inCheck = state.isCheck();
+  if (!inCheck) {
+    // stand pat: the side to move need not capture
+    frame.staticEval = Eval::eval(state, pawnTable, evalCache, alpha, beta);
+    if (frame.staticEval >= beta || ply == maxPly) {
+      return frame.staticEval;
+    }
+    alpha = std::max(alpha, frame.staticEval);
+    state.generatePseudoLegalMoves<GenerationMode::captures>(frame.moves);
+  } else if (ply == maxPly) {
+    return Eval::eval(state, pawnTable, evalCache, -INF, INF);
+  } else {
+    state.generatePseudoLegalMoves<GenerationMode::evasions>(frame.moves);
+  }
+  int legalMoves = 0;
+
+  scoreMoves(state, frame);
+  for (std::size_t i = 0; i < frame.moves.size(); i++) {
+    Move m = pickMove(frame, i);
+    if (!state.isLegal(m)) continue;
+    legalMoves++;
     state.executeMove(m);
-    int score = -negatedMax(state, 5, -INF, +INF);
-    if (score > bestScore) {
-      bestScore = score;
-      bestMove = m;
+    int eval = -quiescence(state, ply + 1, -beta, -alpha);
+    state.undoMove(m);
+    if (eval >= beta) {
+      return beta;
+    }
+    if (eval > alpha) {
+      alpha = eval;
+      frame.pv.assign(m, stack[ply + 1].pv);
+    }
+  }
+  if (inCheck && legalMoves == 0) {
+    return -INF;
+  }
+  return alpha;
+}
+
+/// @brief Searches the root moves from index `first` on and moves the best
+/// of them to index `first`. Moves before `first` are the principal
+/// variations found earlier in this iteration and are thereby excluded.
+void Searcher::searchLine(GameState& state, int depth, std::size_t first) {
+  int alpha = -INF;
+  auto best = rootMoves.end();
+  for (auto rootMove = rootMoves.begin() + first; rootMove != rootMoves.end();
+       ++rootMove) {
+    state.executeMove(rootMove->move);
+    int score = -negatedMax(state, 1, depth - 1, -INF, -alpha);
+    state.undoMove(rootMove->move);
+    rootMove->score = score;
+    if (score > alpha || best == rootMoves.end()) {
+      alpha = score;
+      best = rootMove;
+      rootMove->pv.assign(rootMove->move, stack[1].pv);
+    }
+  }
+  std::rotate(rootMoves.begin() + first, best, best + 1);
+}
+
+/// @brief Removes the root moves that would throw away the root position's
+/// tablebase result, if it has one. If the tables know the distance to mate
+/// after every move, only the moves that mate fastest (or, when losing, the
+/// slowest) remain: the search alone may not make progress in a won
+/// endgame. The remaining moves are searched as usual.
+void Searcher::filterRootMoves(GameState& state) {
+  auto root = Tablebases::probeWDL(state);
+  if (!root) {
+    return;
+  }
+  // The scores hold the preference of each move until the search: wins
+  // before draws before losses, fast wins and slow losses first.
+  bool distances = true;
+  for (RootMove& rootMove : rootMoves) {
+    state.executeMove(rootMove.move);
+    auto result = Tablebases::probeWDL(state);
+    auto plies = Tablebases::probeDTM(state);
+    state.undoMove(rootMove.move);
+    distances = distances && result && plies;
+    if (distances) {
+      rootMove.score = -*result * (tablebaseWin - std::abs(*plies) - 1);
+    }
+  }
+  if (distances && !rootMoves.empty()) {
+    int best = std::max_element(rootMoves.begin(), rootMoves.end(),
+                                [](const RootMove& a, const RootMove& b) {
+                                  return a.score < b.score;
+                                })
+                   ->score;
+    rootMoves.erase(
+        std::remove_if(rootMoves.begin(), rootMoves.end(),
+                       [best](const RootMove& m) { return m.score < best; }),
+        rootMoves.end());
+  }
+  for (RootMove& rootMove : rootMoves) rootMove.score = -INF;
+  if (distances) {
+    return;
+  }
+  auto worse = [&](const RootMove& rootMove) {
+    state.executeMove(rootMove.move);
+    auto result = Tablebases::probeWDL(state);
+    state.undoMove(rootMove.move);
+    return result && -*result < *root;
+  };
+  rootMoves.erase(std::remove_if(rootMoves.begin(), rootMoves.end(), worse),
+                  rootMoves.end());
+}
+
+/// @brief Writes the score in the UCI format, either in centipawns or, for
+/// mates, in moves until mate (negative if we are the ones getting mated).
+void writeScore(std::ostream& out, const RootMove& line) {
+  if (line.score == INF) {
+    out << "mate " << (line.pv.length + 1) / 2;
+  } else if (line.score == -INF) {
+    out << "mate " << -(line.pv.length / 2);
+  } else {
+    out << "cp " << line.score;
+  }
+}
+
+Move Searcher::search(GameState& state, const Options& options,
+                      std::ostream& info) {
+  nodeCount = 0;
+  tablebaseHits = 0;
+  pawnTable.resetStatistics();
+  // cached evaluations may stem from other evaluation settings
+  if (evalCache.size() != Eval::EvalCache::entriesFor(options.evalCacheKiB)) {
+    evalCache.resize(options.evalCacheKiB);
+  } else {
+    evalCache.clear();
+    evalCache.resetStatistics();
+  }
+  if (NNUE::enabled()) {
+    state.attachAccumulators(accumulators.data());
+  }
+  Frame& root = stack[0];
+  state.generateLegalMoves(root.moves);
+  scoreMoves(state, root);
+  rootMoves.clear();
+  for (std::size_t i = 0; i < root.moves.size(); i++) {
+    rootMoves.emplace_back(pickMove(root, i));
+  }
+  filterRootMoves(state);
+  std::size_t lines =
+      std::min(static_cast<std::size_t>(std::max(options.multiPV, 1U)),
+               rootMoves.size());
+
+  for (int depth = 1; depth <= std::min(options.depth, maxPly); depth++) {
+    // The principal variations of the last iteration are searched first,
+    // the remaining moves in the order of their last (upper bound) scores.
+    // (An insertion sort, as std::stable_sort may allocate a buffer.)
+    auto better = [](const RootMove& a, const RootMove& b) {
+      return a.score > b.score;
+    };
+    auto unsorted = rootMoves.begin() + lines;
+    for (auto i = unsorted; i != rootMoves.end(); ++i) {
+      std::rotate(std::upper_bound(unsorted, i, *i, better), i, i + 1);
+    }
+    for (std::size_t k = 0; k < lines; k++) {
+      searchLine(state, depth, k);
+    }
+    for (std::size_t k = 0; k < lines; k++) {
+      info << "info depth " << depth << " multipv " << (k + 1) << " score ";
+      writeScore(info, rootMoves[k]);
+      info << " nodes " << nodeCount << " tbhits " << tablebaseHits << " pv";
+      for (int i = 0; i < rootMoves[k].pv.length; i++) {
+        info << ' ' << rootMoves[k].pv.moves[i];
+      }
+      info << '\n';
     }
-    state.undoMove();
   }
-  return bestMove;
+  state.detachAccumulators();
+  return rootMoves.front().move;
 }
 
-Move search(GameState& state) { return negatedMaxSearch(state); }
+Move search(GameState& state, const Options& options, std::ostream& info) {
+  return Searcher{}.search(state, options, info);
+}
 
 }  // namespace Dagor::Search
@@ -1,11 +1,127 @@
 #ifndef SEARCH_H
 #define SEARCH_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "eval.h"
 #include "game_state.h"
+#include "pawns.h"
 
 namespace Dagor::Search {
 
-Move search(GameState& state);
+/// @brief The maximal number of plies the search can go deep.
+constexpr int maxPly = 64;
+static_assert(maxPly < GameState::undoCapacity,
+              "The undo stack must hold the moves of the deepest line.");
+
+/// @brief The settings of a search, as configured through the UCI options and
+/// the arguments of the `go` command.
+struct Options {
+  /// @brief The number of principal variations that are searched and reported
+  /// in each iteration (UCI option `MultiPV`).
+  unsigned multiPV = 1;
+  /// @brief The depth in plies of the last iteration.
+  int depth = 6;
+  /// @brief The size of the evaluation cache in KiB (UCI option
+  /// `EvalCache`), see `Eval::EvalCache`.
+  std::size_t evalCacheKiB = Eval::EvalCache::defaultKiB;
+};
+
+/// @brief A principal variation: the moves both sides are expected to play.
+struct Line {
+  std::array<Move, maxPly> moves;
+  int length;
+
+  Line() : moves(), length{0} {}
+
+  /// @brief Replaces this line by `move` followed by `continuation`.
+  void assign(Move move, const Line& continuation) {
+    moves[0] = move;
+    std::copy(continuation.moves.begin(),
+              continuation.moves.begin() + continuation.length,
+              moves.begin() + 1);
+    length = continuation.length + 1;
+  }
+};
+
+/// @brief Everything the search needs at one ply. The frames of all plies
+/// are allocated once per search, so visiting a node does not allocate.
+struct Frame {
+  MoveList moves;
+  /// @brief The ordering scores of `moves`, by index.
+  std::array<int, MoveList::capacity> scores;
+  /// @brief Quiet moves that recently caused a beta cutoff at this ply.
+  std::array<Move, 2> killers;
+  int staticEval;
+  Line pv;
+
+  Frame() : moves(), scores(), killers(), staticEval{0}, pv() {}
+};
+
+/// @brief A legal move in the root position together with what the search
+/// has found out about it so far.
+struct RootMove {
+  Move move;
+  /// @brief The score of the last search of this move. It is only exact for
+  /// the moves that were chosen as one of the principal variations, for all
+  /// others it is an upper bound.
+  int score;
+  /// @brief The principal variation starting with `move`.
+  Line pv;
+
+  explicit RootMove(Move move);
+};
+
+/// @brief Owns the search stack of one search thread. All memory is allocated
+/// in the constructor; `search` itself does not allocate.
+class Searcher {
+ private:
+  std::vector<Frame> stack;
+  /// @brief The NNUE accumulators of the positions along the searched line,
+  /// attached to the searched `GameState` while the network is enabled.
+  std::vector<NNUE::Accumulator> accumulators;
+  std::vector<RootMove> rootMoves;
+  std::uint64_t nodeCount;
+  std::uint64_t tablebaseHits;
+  Eval::PawnTable pawnTable;
+  Eval::EvalCache evalCache;
+
+  int negatedMax(GameState& state, int ply, int depth, int alpha, int beta);
+  int quiescence(GameState& state, int ply, int alpha, int beta);
+  void searchLine(GameState& state, int depth, std::size_t first);
+  void filterRootMoves(GameState& state);
+
+ public:
+  Searcher();
+
+  /// @brief Searches the best move with iterative deepening. For each
+  /// iteration and each of the `options.multiPV` best lines an `info` line
+  /// is written to `info`.
+  /// @param state the position to search; it is restored before returning.
+  /// @param options the search settings.
+  /// @param info the stream that receives the UCI `info` output.
+  /// @return the best move.
+  Move search(GameState& state, const Options& options, std::ostream& info);
+
+  /// @brief The number of nodes visited by the last search.
+  std::uint64_t nodes() const { return nodeCount; }
+  /// @brief The number of positions of the last search that were looked up
+  /// in the tablebases.
+  std::uint64_t tbHits() const { return tablebaseHits; }
+  /// @brief The pawn hash table, with the statistics of the last search.
+  const Eval::PawnTable& pawns() const { return pawnTable; }
+  /// @brief The evaluation cache, with the statistics of the last search.
+  const Eval::EvalCache& evals() const { return evalCache; }
+};
+
+/// @brief Searches with a freshly allocated `Searcher`, see `Searcher::search`.
+Move search(GameState& state, const Options& options = {},
+            std::ostream& info = std::cout);
 
 }  // namespace Dagor::Search
 
-#endif
\ No newline at end of file
+#endif
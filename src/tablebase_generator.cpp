@@ -0,0 +1,507 @@
+/// @file tablebase_generator.cpp
+/// The `gentb` mode: generates the tables of `Tablebases::probeDTM` by
+/// retrograde analysis.
+///
+/// All positions of a table are first classified on their own: impossible
+/// positions, mates and stalemates, and what the captures and promotions
+/// lead to (looked up in the tables of the smaller materials, which are
+/// generated first). Then the passes `k = 1, 2, ...` decide the positions
+/// won in `k` plies (for odd `k`) or lost in `k` plies (even `k`): the
+/// moves decided in the previous pass are taken back to find the candidates
+/// (a position from which one can move into a lost position is won; one
+/// from which one can move into a won position may be lost, if all its
+/// other moves lead into won positions as well, which is verified by
+/// generating its moves). What is left undecided in the end is a draw.
+///
+/// The passes work on bit sets of the positions in a work array that is
+/// mapped from a temporary file, so that the operating system can page it
+/// out. Each thread decides the positions of its own range; only the marks
+/// of the candidates are set across ranges, atomically.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "game_state.h"
+#include "movetables.h"
+#include "tablebases.h"
+
+namespace Dagor::Tablebases {
+
+namespace {
+
+using BitBoards::BitBoard;
+using Squares = std::array<Square::t, Layout::maxPieces>;
+
+/// @brief A zeroed array of bytes mapped from a temporary file in
+/// `directory`, which is removed right away, or from anonymous memory if
+/// there is no such file.
+class WorkArray {
+ public:
+  WorkArray(std::size_t size, const std::string &directory)
+      : memory{MAP_FAILED}, size{size} {
+    std::string path = directory + "/gentb-work-XXXXXX";
+    int file = mkstemp(path.data());
+    if (file >= 0) {
+      unlink(path.c_str());
+      if (ftruncate(file, size) == 0) {
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      file, 0);
+      }
+      close(file);
+    }
+    if (memory == MAP_FAILED) {
+      memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (memory == MAP_FAILED) {
+      throw std::bad_alloc{};
+    }
+  }
+  WorkArray(const WorkArray &) = delete;
+  WorkArray &operator=(const WorkArray &) = delete;
+  ~WorkArray() { munmap(memory, size); }
+
+  std::uint8_t *data() { return static_cast<std::uint8_t *>(memory); }
+
+ private:
+  void *memory;
+  std::size_t size;
+};
+
+/// @brief A set of positions, one bit each.
+class BitSet {
+ public:
+  BitSet() : words{nullptr} {}
+  explicit BitSet(std::uint8_t *memory)
+      : words{reinterpret_cast<std::uint64_t *>(memory)} {}
+
+  bool contains(std::size_t i) const { return (words[i / 64] >> (i % 64)) & 1; }
+  void insert(std::size_t i) { words[i / 64] |= std::uint64_t{1} << (i % 64); }
+  /// @brief `insert` for sets that other threads insert into as well.
+  void insertAtomically(std::size_t i) {
+    __atomic_fetch_or(&words[i / 64], std::uint64_t{1} << (i % 64),
+                      __ATOMIC_RELAXED);
+  }
+  /// @brief Calls `action` for each position in `[begin, end)` and removes
+  /// them; both must be multiples of 64.
+  template <typename Action>
+  void drain(std::size_t begin, std::size_t end, Action action) {
+    for (std::size_t word = begin / 64; word < end / 64; word++) {
+      BitBoard bits{words[word]};
+      words[word] = 0;
+      for (Square::t bit : bits) action(word * 64 + bit);
+    }
+  }
+
+ private:
+  std::uint64_t *words;
+};
+
+/// @brief A table that is being or has been generated.
+struct Table {
+  Layout layout;
+  WorkArray work;
+  /// @brief `Value`s by index; 0 until a position is decided.
+  Value::t *values;
+  /// @brief The possible positions.
+  BitSet legal;
+  /// @brief The positions decided in the last pass.
+  BitSet frontier;
+  /// @brief The positions to decide in the current pass.
+  BitSet candidates;
+
+  Table(const Layout &layout, const std::string &directory)
+      : layout{layout},
+        work(layout.size() + 3 * (layout.size() / 8), directory),
+        values{work.data()},
+        legal{work.data() + layout.size()},
+        frontier{work.data() + layout.size() + layout.size() / 8},
+        candidates{work.data() + layout.size() + 2 * (layout.size() / 8)} {}
+  Table(const Table &) = delete;
+  Table &operator=(const Table &) = delete;
+};
+
+/// @brief What the moves of a position lead to, from the point of view of
+/// the side to move.
+struct Successors {
+  int moves = 0;
+  /// @brief The moves that stay in the table.
+  int inTable = 0;
+  /// @brief The plies to the fastest win, 0 if no move wins (yet).
+  int fastestWin = 0;
+  /// @brief Whether all moves lose (as far as known).
+  bool allLose = true;
+  /// @brief The plies to the slowest loss.
+  int slowestLoss = 0;
+};
+
+class Generator {
+ public:
+  Generator(std::string directory, unsigned threads, std::ostream &log)
+      : directory{std::move(directory)},
+        threads{std::max(threads, 1u)},
+        log(log),
+        tables(),
+        empty{"8/8/8/8/8/8/8/8 w - - 0 1"},
+        pendingMutex(),
+        pending() {}
+
+  /// @brief Generates the table of `layout` and those it depends on, unless
+  /// they have been generated already.
+  bool solve(const Layout &layout);
+
+ private:
+  std::string directory;
+  unsigned threads;
+  std::ostream &log;
+  std::map<Eval::MaterialKey, std::unique_ptr<Table>> tables;
+  const Position empty;
+  std::mutex pendingMutex;
+  /// @brief By pass, the positions known to be decided in that pass
+  /// through their captures and promotions.
+  std::vector<std::vector<std::uint32_t>> pending;
+
+  /// @brief The value of a position after a move that left the table.
+  Value::t exitValue(const Position &position) const;
+  /// @brief The position of an index, or `std::nullopt` if it is impossible.
+  std::optional<Position> position(const Table &table,
+                                   std::size_t index) const;
+  Successors successors(const Table &table, const Position &position,
+                        bool exitsOnly) const;
+  void addPending(int pass, std::size_t index);
+  /// @brief Marks the positions from which a move leads to `index`.
+  void markPredecessors(Table &table, std::size_t index) const;
+  /// @brief Runs `work(begin, end)` on `threads` ranges of `[0, size)`.
+  template <typename Work>
+  void parallel(std::size_t size, Work work) const;
+  void generate(Table &table);
+};
+
+/// @brief The layouts of the materials a move can lead to from `layout`:
+/// after a capture, a promotion or both. Only those with pieces besides the
+/// kings, with the stronger side as white.
+std::vector<Layout> exits(const Layout &layout) {
+  std::vector<Eval::MaterialKey> keys;
+  for (int i = 2; i < layout.count; i++) {
+    Eval::MaterialKey without =
+        layout.key - Eval::materialKey(layout.pieces[i], layout.colors[i]);
+    keys.push_back(without);
+    if (layout.pieces[i] != Piece::pawn) continue;
+    for (Piece::t promotion : Piece::officers) {
+      Eval::MaterialKey promoted =
+          without + Eval::materialKey(promotion, layout.colors[i]);
+      keys.push_back(promoted);
+      for (int j = 2; j < layout.count; j++) {
+        if (layout.colors[j] != layout.colors[i]) {
+          keys.push_back(promoted -
+                         Eval::materialKey(layout.pieces[j], layout.colors[j]));
+        }
+      }
+    }
+  }
+  std::vector<Layout> result;
+  for (Eval::MaterialKey key : keys) {
+    if (key == 0) continue;
+    std::array<int, Color::size> worth{};
+    std::array<std::string, Color::size> names = {"K", "K"};
+    for (Color::t color : Color::all) {
+      for (Piece::t piece :
+           {Piece::queen, Piece::rook, Piece::bishop, Piece::knight,
+            Piece::pawn}) {
+        int count = Eval::pieceCount(key, piece, color);
+        worth[color] += count * Piece::worth[piece];
+        names[color].append(count, Piece::name(piece, Color::white));
+      }
+    }
+    bool swap = worth[Color::black] > worth[Color::white];
+    result.push_back(*Layout::parse(swap ? names[1] + "v" + names[0]
+                                         : names[0] + "v" + names[1]));
+  }
+  return result;
+}
+
+bool Generator::solve(const Layout &layout) {
+  if (tables.count(layout.key) != 0 ||
+      tables.count(Eval::swapColors(layout.key)) != 0) {
+    return true;
+  }
+  for (const Layout &exit : exits(layout)) {
+    if (!solve(exit)) return false;
+  }
+  auto table = std::make_unique<Table>(layout, directory);
+  generate(*table);
+  std::string path = directory + "/" + layout.name() + ".dtb";
+  tables.emplace(layout.key, std::move(table));
+  if (!save(path, layout, tables[layout.key]->values)) {
+    log << "cannot write " << path << "\n";
+    return false;
+  }
+  return true;
+}
+
+Value::t Generator::exitValue(const Position &position) const {
+  if (position.materialKey == 0) {
+    return Value::draw;
+  }
+  auto table = tables.find(position.materialKey);
+  bool swapColors = table == tables.end();
+  if (swapColors) {
+    table = tables.find(Eval::swapColors(position.materialKey));
+  }
+  const Layout &layout = table->second->layout;
+  return table->second->values[layout.index(position, swapColors)];
+}
+
+std::optional<Position> Generator::position(const Table &table,
+                                             std::size_t index) const {
+  const Layout &layout = table.layout;
+  Color::t us;
+  Squares squares{};
+  layout.squares(index, us, squares);
+  Position position{empty};
+  for (int i = 0; i < layout.count; i++) {
+    Coord::t rank = Square::rank(squares[i]);
+    if (position.getPiece(squares[i]) != Piece::empty ||
+        (layout.pieces[i] == Piece::pawn &&
+         (rank == 0 || rank == Coord::width - 1))) {
+      return std::nullopt;
+    }
+    position.set(squares[i], layout.pieces[i], layout.colors[i]);
+  }
+  position.next = us;
+  Square::t theirKing = squares[us == Color::white ? 1 : 0];
+  if (position.attackMap(us).isSet(theirKing)) {
+    return std::nullopt;
+  }
+  position.updateCheckInfo();
+  return position;
+}
+
+Successors Generator::successors(const Table &table, const Position &position,
+                                 bool exitsOnly) const {
+  Successors result;
+  MoveList moves;
+  position.generateLegalMoves(moves);
+  for (Move m : moves) {
+    result.moves++;
+    Position after = position.apply(m);
+    Value::t value;
+    if (after.materialKey == position.materialKey) {
+      result.inTable++;
+      if (exitsOnly) {
+        result.allLose = false;
+        continue;
+      }
+      value = table.values[table.layout.index(after, false)];
+    } else {
+      value = exitValue(after);
+    }
+    int plies = Value::plies(value);
+    if (Value::wdl(value) == WDL::loss) {
+      // the opponent is lost after this move
+      if (result.fastestWin == 0 || 1 - plies < result.fastestWin) {
+        result.fastestWin = 1 - plies;
+      }
+    }
+    if (Value::wdl(value) == WDL::win) {
+      result.slowestLoss = std::max(result.slowestLoss, plies + 1);
+    } else {
+      result.allLose = false;
+    }
+  }
+  return result;
+}
+
+void Generator::addPending(int pass, std::size_t index) {
+  std::lock_guard<std::mutex> lock{pendingMutex};
+  if (pending.size() <= static_cast<std::size_t>(pass)) {
+    pending.resize(pass + 1);
+  }
+  pending[pass].push_back(static_cast<std::uint32_t>(index));
+}
+
+void Generator::markPredecessors(Table &table, std::size_t index) const {
+  const Layout &layout = table.layout;
+  Color::t us;
+  Squares squares{};
+  layout.squares(index, us, squares);
+  Color::t them = Color::opponent(us);
+  BitBoard occupancy{};
+  for (int i = 0; i < layout.count; i++) occupancy.setSquare(squares[i]);
+
+  for (int i = 0; i < layout.count; i++) {
+    if (layout.colors[i] != them) continue;
+    Square::t square = squares[i];
+    BitBoard origins{};
+    switch (layout.pieces[i]) {
+      case Piece::king:
+        origins = MoveTables::kingMoves(square);
+        break;
+      case Piece::knight:
+        origins = MoveTables::knightMoves(square);
+        break;
+      case Piece::bishop:
+        origins = MoveTables::bishopMoves(square, occupancy);
+        break;
+      case Piece::rook:
+        origins = MoveTables::rookMoves(square, occupancy);
+        break;
+      case Piece::queen:
+        origins = MoveTables::bishopMoves(square, occupancy) |
+                  MoveTables::rookMoves(square, occupancy);
+        break;
+      case Piece::pawn: {
+        int down = them == Color::white ? Square::south : Square::north;
+        Coord::t rank = Square::rank(Square::reverseForColor(square, them));
+        if (rank >= 2) {
+          origins.setSquare(square + down);
+        }
+        if (rank == 3 && !occupancy.isSet(square + down)) {
+          origins.setSquare(square + 2 * down);
+        }
+        break;
+      }
+    }
+    origins &= ~occupancy;
+    for (Square::t origin : origins) {
+      Squares before = squares;
+      before[i] = origin;
+      std::size_t predecessor = layout.index(them, before);
+      if (table.legal.contains(predecessor)) {
+        table.candidates.insertAtomically(predecessor);
+      }
+    }
+  }
+}
+
+template <typename Work>
+void Generator::parallel(std::size_t size, Work work) const {
+  std::size_t chunk = (size / 64 + threads - 1) / threads * 64;
+  std::vector<std::thread> workers;
+  for (std::size_t begin = 0; begin < size; begin += chunk) {
+    workers.emplace_back(work, begin, std::min(begin + chunk, size));
+  }
+  for (auto &worker : workers) worker.join();
+}
+
+void Generator::generate(Table &table) {
+  auto start = std::chrono::steady_clock::now();
+  std::size_t size = table.layout.size();
+  pending.clear();
+
+  // pass 0: impossible positions, mates, and captures and promotions
+  parallel(size, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t index = begin; index < end; index++) {
+      auto position = this->position(table, index);
+      if (!position) continue;
+      table.legal.insert(index);
+      Successors next = successors(table, *position, true);
+      if (next.moves == 0 && position->isCheck()) {
+        table.values[index] = Value::lossIn(0);
+        table.frontier.insert(index);
+      } else if (next.fastestWin != 0) {
+        addPending(next.fastestWin, index);
+      } else if (next.moves > 0 && next.inTable == 0 && next.allLose) {
+        addPending(next.slowestLoss, index);
+      }
+    }
+  });
+
+  int pass = 1;
+  for (;; pass++) {
+    parallel(size, [&](std::size_t begin, std::size_t end) {
+      table.frontier.drain(begin, end, [&](std::size_t index) {
+        markPredecessors(table, index);
+      });
+    });
+    if (static_cast<std::size_t>(pass) < pending.size()) {
+      for (std::uint32_t index : pending[pass]) {
+        table.candidates.insert(index);
+      }
+    }
+    bool wins = pass % 2 == 1;
+    std::size_t decided = 0;
+    std::mutex decidedMutex;
+    parallel(size, [&](std::size_t begin, std::size_t end) {
+      std::size_t count = 0;
+      table.candidates.drain(begin, end, [&](std::size_t index) {
+        if (table.values[index] != Value::draw) return;
+        if (!wins) {
+          Successors next =
+              successors(table, *this->position(table, index), false);
+          if (!next.allLose || next.moves == 0) return;
+          if (next.slowestLoss > pass) {
+            addPending(next.slowestLoss, index);
+            return;
+          }
+        }
+        table.frontier.insert(index);
+        count++;
+      });
+      std::lock_guard<std::mutex> lock{decidedMutex};
+      decided += count;
+    });
+    // decided only now, so that the passes above read the values of the
+    // last pass only
+    parallel(size, [&](std::size_t begin, std::size_t end) {
+      for (std::size_t word = begin; word < end; word += 64) {
+        for (std::size_t index = word; index < word + 64; index++) {
+          if (table.frontier.contains(index)) {
+            table.values[index] =
+                wins ? Value::winIn(pass) : Value::lossIn(pass);
+          }
+        }
+      }
+    });
+    bool morePending = false;
+    for (std::size_t later = pass + 1; later < pending.size(); later++) {
+      morePending |= !pending[later].empty();
+    }
+    if (decided == 0 && !morePending) break;
+  }
+
+  // The values of impossible positions do not matter; repeating the last
+  // value makes the runs longer.
+  std::size_t counts[3] = {0, 0, 0};
+  int longest = 0;
+  Value::t last = Value::draw;
+  for (std::size_t index = 0; index < size; index++) {
+    if (!table.legal.contains(index)) {
+      table.values[index] = last;
+      continue;
+    }
+    last = table.values[index];
+    counts[Value::wdl(last) + 1]++;
+    longest = std::max(longest, std::abs(Value::plies(last)));
+  }
+  auto time = std::chrono::steady_clock::now() - start;
+  log << table.layout.name() << ": " << counts[2] << " wins, " << counts[1]
+      << " draws, " << counts[0] << " losses, longest mate in " << longest
+      << " plies, " << pass << " passes, "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(time).count()
+      << " ms\n";
+}
+
+}  // namespace
+
+bool generate(const std::string &material, const std::string &directory,
+              unsigned threads, std::ostream &log) {
+  auto layout = Layout::parse(material);
+  if (!layout || layout->count < 3) {
+    return false;
+  }
+  return Generator{directory, threads, log}.solve(*layout);
+}
+
+}  // namespace Dagor::Tablebases
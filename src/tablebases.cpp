@@ -0,0 +1,389 @@
+#include "tablebases.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "game_state.h"
+#include "material.h"
+#include "movetables.h"
+
+namespace Dagor::Tablebases {
+
+namespace {
+
+constexpr char dagorMagic[] = "Dagor-in-Erain TB 1";
+
+/// @brief The start of a table of `gentb`. It is followed by the offsets of
+/// the `blockCount` blocks (and of the end of the last) from the start of
+/// the blocks, as `std::uint32_t`, and the blocks. A block is a sequence of
+/// runs: one byte for the length of the run minus one, one for the value.
+struct TableHeader {
+  std::array<char, 32> magic;
+  std::uint64_t positions;
+  std::uint32_t blockSize;
+  std::uint32_t blockCount;
+  std::array<char, 16> reserved;
+};
+
+static_assert(sizeof(TableHeader) == 64,
+              "The offsets of a mapped table must stay aligned.");
+
+/// @brief The positions per block.
+constexpr std::uint32_t blockSize = 4096;
+
+/// @brief The pieces of king and pawn against king.
+constexpr int kpkPieces = 3;
+
+/// @brief A table file found on the path. It is mapped when it is first
+/// probed and unmapped when the tables are replaced.
+class TableFile {
+ public:
+  TableFile(std::string path, const Layout &layout)
+      : layout{layout},
+        path{std::move(path)},
+        mapOnce(),
+        memory{nullptr},
+        size{0} {}
+  TableFile(const TableFile &) = delete;
+  TableFile &operator=(const TableFile &) = delete;
+  ~TableFile() {
+    if (memory != nullptr) {
+      munmap(const_cast<std::uint8_t *>(memory), size);
+    }
+  }
+
+  const Layout layout;
+
+  /// @brief The mapped file, or `nullptr` if it cannot be mapped or is not
+  /// a table. The first thread to ask maps it; the others wait for it.
+  const std::uint8_t *data() {
+    std::call_once(mapOnce, [this] { map(); });
+    return memory;
+  }
+
+  /// @brief The value of an index of a table of `gentb`.
+  Value::t value(std::size_t index) {
+    const std::uint8_t *table = data();
+    auto header = reinterpret_cast<const TableHeader *>(table);
+    auto offsets =
+        reinterpret_cast<const std::uint32_t *>(table + sizeof(TableHeader));
+    const std::uint8_t *blocks =
+        table + sizeof(TableHeader) +
+        (header->blockCount + 1) * sizeof(std::uint32_t);
+    std::size_t block = index / header->blockSize;
+    const std::uint8_t *run = blocks + offsets[block];
+    // the runs of a corrupt block may not cover it
+    const std::uint8_t *lastRun = blocks + offsets[block + 1] - 2;
+    std::size_t remaining = index % header->blockSize;
+    while (remaining > run[0] && run != lastRun) {
+      remaining -= run[0] + 1;
+      run += 2;
+    }
+    return run[1];
+  }
+
+ private:
+  std::string path;
+  std::once_flag mapOnce;
+  const std::uint8_t *memory;
+  std::size_t size;
+
+  void map() {
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+      return;
+    }
+    struct stat info {};
+    void *mapped = MAP_FAILED;
+    if (fstat(file, &info) == 0 &&
+        static_cast<std::size_t>(info.st_size) >= sizeof(TableHeader)) {
+      mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, file, 0);
+    }
+    close(file);
+    if (mapped == MAP_FAILED) {
+      return;
+    }
+    if (!isValid(static_cast<const std::uint8_t *>(mapped), info.st_size)) {
+      munmap(mapped, info.st_size);
+      return;
+    }
+    memory = static_cast<const std::uint8_t *>(mapped);
+    size = info.st_size;
+  }
+
+  bool isValid(const std::uint8_t *table, std::size_t tableSize) const {
+    auto header = reinterpret_cast<const TableHeader *>(table);
+    if (std::memcmp(header->magic.data(), dagorMagic, sizeof(dagorMagic)) !=
+            0 ||
+        header->positions != layout.size() || header->blockSize == 0 ||
+        header->blockCount !=
+            (header->positions + header->blockSize - 1) / header->blockSize) {
+      return false;
+    }
+    std::size_t blocks = sizeof(TableHeader) +
+                         (header->blockCount + 1) * sizeof(std::uint32_t);
+    if (blocks > tableSize) {
+      return false;
+    }
+    auto offsets =
+        reinterpret_cast<const std::uint32_t *>(table + sizeof(TableHeader));
+    if (offsets[0] != 0 || blocks + offsets[header->blockCount] != tableSize) {
+      return false;
+    }
+    // Every block holds at least one run, and the offsets only grow, so
+    // that they all stay within the file.
+    for (std::uint32_t block = 0; block < header->blockCount; block++) {
+      if (offsets[block + 1] <= offsets[block] ||
+          (offsets[block + 1] - offsets[block]) % 2 != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+/// @brief A table file and whether positions have to swap their colors to
+/// be looked up in it.
+struct Entry {
+  TableFile *file;
+  bool swapColors;
+};
+
+std::vector<std::unique_ptr<TableFile>> files;
+/// @brief The files by the material keys they cover, both colors each.
+std::unordered_map<Eval::MaterialKey, Entry> byMaterial;
+int largestPieces = kpkPieces;
+
+/// @brief The table of a position, if any.
+std::optional<Entry> findTable(const Position &position) {
+  if (position.castlingRights != CastlingRights::none) {
+    return std::nullopt;
+  }
+  auto entry = byMaterial.find(position.materialKey);
+  if (entry == byMaterial.end() || entry->second.file->data() == nullptr) {
+    return std::nullopt;
+  }
+  return entry->second;
+}
+
+/// @brief The value of a position from a table of `gentb`, or
+/// `std::nullopt` for positions where en passant is possible.
+std::optional<Value::t> probeValue(const Position &position) {
+  auto entry = findTable(position);
+  if (!entry || position.enPassantSquare != Square::noSquare) {
+    return std::nullopt;
+  }
+  return entry->file->value(
+      entry->file->layout.index(position, entry->swapColors));
+}
+
+}  // namespace
+
+std::size_t init(const std::string &path) {
+  byMaterial.clear();
+  files.clear();
+  largestPieces = kpkPieces;
+  std::istringstream directories{path};
+  std::string directory;
+  while (std::getline(directories, directory, ':')) {
+    if (directory.empty()) continue;
+    std::error_code error;
+    for (const auto &entry :
+         std::filesystem::directory_iterator{directory, error}) {
+      const std::filesystem::path &file = entry.path();
+      if (file.extension() != ".dtb") continue;
+      auto layout = Layout::parse(file.stem().string());
+      if (!layout) continue;
+      files.push_back(
+          std::make_unique<TableFile>(file.string(), *layout));
+      byMaterial.emplace(layout->key, Entry{files.back().get(), false});
+      byMaterial.emplace(Eval::swapColors(layout->key),
+                         Entry{files.back().get(), true});
+      largestPieces = std::max(largestPieces, layout->count);
+    }
+  }
+  return files.size();
+}
+
+int largest() { return largestPieces; }
+
+std::optional<WDL::t> probeKPK(const Position &position) {
+  Color::t strong;
+  if (position.materialKey == Eval::materialKey(Piece::pawn, Color::white)) {
+    strong = Color::white;
+  } else if (position.materialKey ==
+             Eval::materialKey(Piece::pawn, Color::black)) {
+    strong = Color::black;
+  } else {
+    return std::nullopt;
+  }
+  Color::t weak = Color::opponent(strong);
+  BitBoards::BitBoard strongKing = position.forPiece(Piece::king, strong);
+  BitBoards::BitBoard weakKing = position.forPiece(Piece::king, weak);
+  if (strongKing.isEmpty() || weakKing.isEmpty()) {
+    return std::nullopt;
+  }
+  if (!KPK::probe(strong, position.us(), strongKing.findFirstSet(),
+                  position.forPiece(Piece::pawn).findFirstSet(),
+                  weakKing.findFirstSet())) {
+    return WDL::draw;
+  }
+  return position.us() == strong ? WDL::win : WDL::loss;
+}
+
+std::optional<WDL::t> probeWDL(const Position &position) {
+  if (position.castlingRights != CastlingRights::none ||
+      position.occupancy().populationCount() > largestPieces) {
+    return std::nullopt;
+  }
+  if (auto result = probeKPK(position)) {
+    return result;
+  }
+  if (auto value = probeValue(position)) {
+    return Value::wdl(*value);
+  }
+  return std::nullopt;
+}
+
+std::optional<int> probeDTM(const Position &position) {
+  if (auto value = probeValue(position)) {
+    return Value::plies(*value);
+  }
+  return std::nullopt;
+}
+
+std::optional<Layout> Layout::parse(const std::string &name) {
+  std::size_t versus = name.find('v');
+  if (versus == std::string::npos || versus + 1 == name.size() ||
+      name.front() != 'K' || name[versus + 1] != 'K' ||
+      name.size() - 1 > maxPieces) {
+    return std::nullopt;
+  }
+  Layout layout;
+  layout.count = 2;
+  layout.pieces[0] = layout.pieces[1] = Piece::king;
+  layout.colors[0] = Color::white;
+  layout.colors[1] = Color::black;
+  for (std::size_t i = 0; i < name.size(); i++) {
+    if (i == versus || i == 0 || i == versus + 1) continue;
+    Piece::t piece = Piece::byName(name[i]);
+    if (piece == Piece::empty || piece == Piece::king ||
+        std::islower(name[i])) {
+      return std::nullopt;
+    }
+    Color::t color = i < versus ? Color::white : Color::black;
+    layout.pieces[layout.count] = piece;
+    layout.colors[layout.count] = color;
+    layout.count++;
+    layout.key += Eval::materialKey(piece, color);
+  }
+  return layout;
+}
+
+std::string Layout::name() const {
+  std::string name = "K";
+  for (int i = 2; i < count; i++) {
+    if (colors[i] == Color::white) name += Piece::name(pieces[i], Color::white);
+  }
+  name += "vK";
+  for (int i = 2; i < count; i++) {
+    if (colors[i] == Color::black) name += Piece::name(pieces[i], Color::white);
+  }
+  return name;
+}
+
+std::size_t Layout::index(Color::t us,
+                          std::array<Square::t, maxPieces> squares) const {
+  if (Square::file(squares[0]) >= Coord::width / 2) {
+    for (int i = 0; i < count; i++) squares[i] ^= Coord::width - 1;
+  }
+  std::size_t index = us;
+  index = index * (Square::size / 2) +
+          Square::rank(squares[0]) * (Coord::width / 2) +
+          Square::file(squares[0]);
+  for (int i = 1; i < count; i++) {
+    index = index * Square::size + squares[i];
+  }
+  return index;
+}
+
+std::size_t Layout::index(const Position &position, bool swapColors) const {
+  std::array<Square::t, maxPieces> squares{};
+  for (int i = 0; i < std::min(count, maxPieces); i++) {
+    Color::t color = swapColors ? Color::opponent(colors[i]) : colors[i];
+    BitBoards::BitBoard candidates = position.forPiece(pieces[i], color);
+    // the pieces of the same kind take the squares in order
+    for (int j = 0; j < i; j++) {
+      if (pieces[j] == pieces[i] && colors[j] == colors[i]) {
+        candidates.unsetSquare(candidates.findFirstSet());
+      }
+    }
+    squares[i] = candidates.findFirstSet();
+    if (swapColors) {
+      squares[i] = Square::reverseForColor(squares[i], Color::black);
+    }
+  }
+  Color::t us = swapColors ? Color::opponent(position.us()) : position.us();
+  return index(us, squares);
+}
+
+void Layout::squares(std::size_t index, Color::t &us,
+                     std::array<Square::t, maxPieces> &squares) const {
+  for (int i = count - 1; i >= 1; i--) {
+    squares[i] = static_cast<Square::t>(index % Square::size);
+    index /= Square::size;
+  }
+  std::size_t half = index % (Square::size / 2);
+  squares[0] = Square::index(half % (Coord::width / 2),
+                             half / (Coord::width / 2));
+  us = static_cast<Color::t>(index / (Square::size / 2));
+}
+
+bool save(const std::string &path, const Layout &layout,
+          const Value::t *values) {
+  TableHeader header{};
+  std::copy(std::begin(dagorMagic), std::end(dagorMagic),
+            header.magic.begin());
+  header.positions = layout.size();
+  header.blockSize = blockSize;
+  header.blockCount =
+      static_cast<std::uint32_t>((layout.size() + blockSize - 1) / blockSize);
+  std::vector<std::uint32_t> offsets{0};
+  std::vector<std::uint8_t> blocks;
+  for (std::size_t start = 0; start < layout.size(); start += blockSize) {
+    std::size_t end = std::min<std::size_t>(start + blockSize, layout.size());
+    for (std::size_t i = start; i < end;) {
+      std::size_t run = 1;
+      while (i + run < end && run < 256 && values[i + run] == values[i]) {
+        run++;
+      }
+      blocks.push_back(static_cast<std::uint8_t>(run - 1));
+      blocks.push_back(values[i]);
+      i += run;
+    }
+    offsets.push_back(static_cast<std::uint32_t>(blocks.size()));
+  }
+  std::ofstream out{path, std::ios::binary};
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(offsets.data()),
+            offsets.size() * sizeof(std::uint32_t));
+  out.write(reinterpret_cast<const char *>(blocks.data()), blocks.size());
+  return static_cast<bool>(out);
+}
+
+}  // namespace Dagor::Tablebases
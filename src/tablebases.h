@@ -0,0 +1,131 @@
+#ifndef TABLEBASES_H
+#define TABLEBASES_H
+
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <string>
+
+#include "material.h"
+#include "types.h"
+
+namespace Dagor {
+class Position;
+}
+
+/// @brief Endgame tablebases: the exact results of positions with few pieces,
+/// so that the search need not search them. The KPK bitbase is built in;
+/// table files are looked up in the directories given by the UCI option
+/// `TablebasePath`. A file is only mapped into memory when a position first
+/// probes it, and the mapping is shared read-only by all search threads.
+/// Only the tables of `gentb` are read, not Syzygy files.
+namespace Dagor::Tablebases {
+
+/// @brief The result of a position for the side to move with perfect play,
+/// regardless of the fifty-move rule.
+namespace WDL {
+using t = std::int8_t;
+enum : t { loss = -1, draw = 0, win = 1 };
+}  // namespace WDL
+
+/// @brief How the tables generated by `gentb` (see `generate`) store a
+/// position: 0 for a draw (and for impossible positions), `n` for a win in
+/// `n` plies (odd) and `n + 2` for a loss in `n` plies (even, 0 when mated).
+/// The distances are to mate (DTM).
+namespace Value {
+using t = std::uint8_t;
+constexpr t draw = 0;
+constexpr t winIn(int plies) { return static_cast<t>(plies); }
+constexpr t lossIn(int plies) { return static_cast<t>(plies + 2); }
+constexpr WDL::t wdl(t value) {
+  return value == draw ? WDL::draw : value % 2 == 1 ? WDL::win : WDL::loss;
+}
+/// @return the plies to mate, positive if the side to move mates.
+constexpr int plies(t value) {
+  return value == draw ? 0 : value % 2 == 1 ? value : -(value - 2);
+}
+}  // namespace Value
+
+/// @brief The pieces of a generated table and how its positions are
+/// numbered. The table name lists white's pieces, `v` and black's, e. g.
+/// `KRvKN`; the same table serves the colors swapped. The index of a
+/// position is made of the side to move, the white king's square on the
+/// files a to d (positions with the white king on the other half are
+/// mirrored) and the squares of all other pieces: first the black king,
+/// then white's pieces and black's pieces in the order of the name.
+/// Impossible positions (two pieces on one square, the side not to move in
+/// check) have indices too; what is stored for them is meaningless.
+struct Layout {
+  static constexpr int maxPieces = 4;
+
+  int count = 0;
+  std::array<Piece::t, maxPieces> pieces{};
+  std::array<Color::t, maxPieces> colors{};
+  /// @brief The material key of the position as named.
+  Eval::MaterialKey key = 0;
+
+  /// @brief The layout of a table name, or `std::nullopt` if it is none or
+  /// has more than `maxPieces` pieces.
+  static std::optional<Layout> parse(const std::string &name);
+
+  std::string name() const;
+  std::size_t size() const {
+    return std::size_t{Color::size} * (Square::size / 2)
+           << (6 * (count - 1));
+  }
+
+  /// @brief The index of the squares of the pieces (in the order of the
+  /// layout) with `us` to move.
+  std::size_t index(Color::t us,
+                    std::array<Square::t, maxPieces> squares) const;
+  /// @brief The index of a position with the material of the table, with
+  /// the colors swapped first if `swapColors`.
+  std::size_t index(const Position &position, bool swapColors) const;
+  /// @brief The inverse of `index`: sets `us` and `squares`.
+  void squares(std::size_t index, Color::t &us,
+               std::array<Square::t, maxPieces> &squares) const;
+};
+
+/// @brief Replaces the table files by those in the directories of `path`,
+/// separated by `:`. Files are recognized by their names: the tables of
+/// `gentb` like `KQvKR.dtb`, each for the material of the name with either
+/// color. An empty path leaves only the built-in tables. Must not be called
+/// during a search.
+/// @return the number of table files found.
+std::size_t init(const std::string &path);
+
+/// @brief The most pieces, kings included, that any table covers.
+int largest();
+
+/// @brief The result of king and pawn against king from the built-in
+/// bitbase, or `std::nullopt` for other material.
+std::optional<WDL::t> probeKPK(const Position &position);
+
+/// @brief The result of a position from the tables, or `std::nullopt` if
+/// none covers it. Positions with castling rights are never covered.
+std::optional<WDL::t> probeWDL(const Position &position);
+
+/// @brief The plies to mate of a position from the tables with distances
+/// (those of `gentb`), positive if the side to move mates and 0 for a draw,
+/// or `std::nullopt` if none covers it. The tables do not know en passant,
+/// so positions where it is possible are not covered either.
+std::optional<int> probeDTM(const Position &position);
+
+/// @brief Writes a generated table, one value per index of `layout`, in
+/// blocks that are compressed (run-length encoded) each on their own, so
+/// that a probe only decodes the block of its position.
+bool save(const std::string &path, const Layout &layout,
+          const Value::t *values);
+
+/// @brief Generates the table of a material (e. g. `KRvK`) by retrograde
+/// analysis with `threads` threads and writes it to `<name>.dtb` in
+/// `directory`, together with the tables it depends on (the materials
+/// after captures and promotions). Progress goes to `log`.
+/// @return false if the name is no valid material of 3 to 4 pieces.
+bool generate(const std::string &material, const std::string &directory,
+              unsigned threads, std::ostream &log);
+
+}  // namespace Dagor::Tablebases
+
+#endif
@@ -1,17 +1,46 @@
 #include "test.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 
 #include "bitboard.h"
+#include "eval.h"
 #include "game_state.h"
+#include "nnue.h"
+#include "search.h"
+#include "tablebases.h"
 #include "types.h"
 
 namespace Dagor::Test {
 
+std::size_t (*allocationCount)() = nullptr;
+
+/// @brief An infinite search window for the evaluation.
+constexpr int inf = std::numeric_limits<int>::max();
+
 static unsigned tests = 0;
 static unsigned failures = 0;
 
+const std::array<std::string, 5> benchPositions = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+};
+
 template <typename T>
 std::ostream& operator<<(std::ostream& out, const std::vector<T>& v) {
   out << "[";
@@ -101,14 +130,14 @@ void pieceMovement() {
   assertEquals(kingMoves(Square::a1), {0x302},
                "King in a corner has only three options");
 
-  assertEquals(bishopHashes[Square::c4].lookUp({}), {0x4020110a000a1120},
+  assertEquals(bishopMoves(Square::c4, {}), {0x4020110a000a1120},
                "Unobstructed Bishop moves");
-  assertEquals(bishopHashes[Square::c4].lookUp({0x840010504008018a}),
+  assertEquals(bishopMoves(Square::c4, {0x840010504008018a}),
                {0x110a000a0100}, "Bishop with blocking pieces");
 
-  assertEquals(rookHashes[Square::c4].lookUp({}), {0x4040404fb040404},
+  assertEquals(rookMoves(Square::c4, {}), {0x4040404fb040404},
                "Unobstructed Rook moves");
-  assertEquals(rookHashes[Square::c4].lookUp({0x2440000940a200}),
+  assertEquals(rookMoves(Square::c4, {0x2440000940a200}),
                {0x404040b040404}, "Rook with blocking pieces");
 }
 
@@ -119,15 +148,25 @@ void moveClass() {
   assertEquals(
       Move{"a2a1r"}, Move{Square::a2, Square::a1, Piece::rook},
       "Moves can be constructed from algebraic notation with promotion");
+  assertEquals(Move{"a2a1r"}.promotion(), Piece::t{Piece::rook},
+               "Promotions keep the piece promoted to");
+  assertEquals(
+      GameState{"8/8/8/8/8/8/8/R3K3 w Q - 0 1"}.parseMove("e1c1"), wqCastle,
+      "Parsing a move in a position finds out that it is castling");
+  assertEquals(GameState{"8/8/8/8/2Pp4/8/8/8 b - c3 0 1"}.parseMove("d4c3"),
+               Move::enPassant(Square::d4, Square::c3),
+               "Parsing a move in a position finds out that it is en passant");
 }
 
 void assertMoveGen(std::string_view fen, std::vector<Move> expected,
                    std::string_view msg) {
   GameState s{std::string(fen)};
   auto moves = s.generateLegalMoves();
+  // the notation of the expected moves does not show the kind of a move
+  for (Move& m : moves) m = Move{m.start(), m.end(), m.promotion()};
   auto key = [](Move& a, Move& b) {
-    int a_key = (a.start << 4) + a.end;
-    int b_key = (b.start << 4) + b.end;
+    int a_key = (a.start() << 4) + a.end();
+    int b_key = (b.start() << 4) + b.end();
     return a_key < b_key;
   };
   std::sort(moves.begin(), moves.end(), key);
@@ -196,14 +235,140 @@ void legalMoves() {
                 "En passant discovered check");
 }
 
+/// @brief Counts the moves in the tree below `position` for which
+/// `givesCheck` disagrees with actually making the move.
+unsigned givesCheckErrors(const Position& position, int depth) {
+  if (depth <= 0) {
+    return 0;
+  }
+  MoveList moves;
+  position.generateLegalMoves(moves);
+  unsigned errors = 0;
+  for (Move m : moves) {
+    Position after = position.apply(m);
+    if (position.givesCheck(m) != after.isCheck()) errors++;
+    errors += givesCheckErrors(after, depth - 1);
+  }
+  return errors;
+}
+
+/// @brief Counts the squares where the attack map of `color` and the
+/// attackers found by `getAttacks` disagree.
+unsigned attackMapErrors(const Position& position, Color::t color) {
+  unsigned errors = 0;
+  auto map = position.attackMap(color, position.occupancy());
+  for (Square::t square = 0; square < 64; square++) {
+    bool attacked =
+        !position.getAttacks(square, Color::opponent(color)).isEmpty();
+    if (map.isSet(square) != attacked) errors++;
+  }
+  return errors;
+}
+
+void checkInfo() {
+  header("Check Information");
+  assertEquals(GameState{"8/8/8/8/8/1n2Q3/8/K3r2k w - - 0 1"}.checkers,
+               {0x20010}, "Both checkers are found");
+  assertEquals(
+      GameState{"8/8/8/8/3q4/2B5/8/K3N1r1 w - - 0 1"}.blockersForKing[0],
+      {0x40010}, "Pinned pieces are found");
+  for (auto fen : {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w "
+                   "KQkq - 0 1",
+                   "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+                   "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq "
+                   "- 0 1"}) {
+    assertEquals(givesCheckErrors(GameState{fen}, 3), 0U,
+                 "givesCheck agrees with making the move");
+  }
+  for (auto fen : benchPositions) {
+    GameState position{fen};
+    assertEquals(attackMapErrors(position, Color::white) +
+                     attackMapErrors(position, Color::black),
+                 0U, "The attack map agrees with getAttacks");
+    for (auto color : Color::all) {
+      assertEquals(position.attackMap(color),
+                   position.attackMap(color, position.occupancy()),
+                   "The filled attack map agrees with the looked up one");
+    }
+  }
+  unsigned restored = 0;
+  for (auto fen : benchPositions) {
+    GameState state{fen};
+    for (Move m : state.generateLegalMoves()) {
+      GameState before{state};
+      state.executeMove(m);
+      state.undoMove(m);
+      restored += state.checkers != before.checkers ||
+                  state.blockersForKing != before.blockersForKing ||
+                  state.checkSquares != before.checkSquares;
+    }
+  }
+  assertEquals(restored, 0U, "Undoing a move restores the check information");
+  BitBoards::BitBoard rooks{0x8100000000000081}, bishops{0x2400000000000024};
+  BitBoards::BitBoard empty{0x0000ffffffff0000};
+  assertEquals(BitBoards::slidingAttacks(rooks, bishops, empty),
+               BitBoards::slidingAttacksScalar(rooks, bishops, empty),
+               "The vectorized fill agrees with the scalar one");
+}
+
+/// @brief Counts the positions in the perft tree below `position` where the
+/// generation modes do not split the legal moves as they should: captures
+/// and quiets partition all moves, evasions are all moves when in check and
+/// the quiet checks are the quiet moves that give check.
+unsigned generationModeErrors(const Position& position, int depth) {
+  MoveList all, captures, quiets, evasions, quietChecks;
+  position.generateMoves<GenerationMode::all>(all);
+  position.generateMoves<GenerationMode::captures>(captures);
+  position.generateMoves<GenerationMode::quiets>(quiets);
+  position.generateMoves<GenerationMode::quietChecks>(quietChecks);
+
+  auto contains = [](const MoveList& list, Move move) {
+    return std::find(list.begin(), list.end(), move) != list.end();
+  };
+  unsigned errors = 0;
+  if (captures.size() + quiets.size() != all.size()) errors++;
+  unsigned checks = 0;
+  for (Move m : all) {
+    if (contains(captures, m) == contains(quiets, m)) errors++;
+    if (contains(quiets, m) && position.givesCheck(m)) checks++;
+  }
+  for (Move m : quietChecks) {
+    if (!contains(quiets, m) || !position.givesCheck(m)) errors++;
+  }
+  if (checks != quietChecks.size()) errors++;
+  if (position.isCheck()) {
+    position.generateMoves<GenerationMode::evasions>(evasions);
+    if (evasions.size() != all.size()) errors++;
+  }
+
+  if (depth > 1) {
+    for (Move m : all) {
+      errors += generationModeErrors(position.apply(m), depth - 1);
+    }
+  }
+  return errors;
+}
+
+void generationModes() {
+  header("Generation Modes");
+  for (const auto& fen : benchPositions) {
+    assertEquals(generationModeErrors(GameState{fen}, 3), 0U,
+                 "The generation modes split the legal moves");
+  }
+  assertEquals(
+      generationModeErrors(
+          GameState{"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"}, 4),
+      0U, "The generation modes split the legal moves");
+}
+
 void assertMoveMaker(std::string_view start, std::string_view move,
                      std::string_view end, std::string_view msg) {
   GameState s{std::string{start}};
   GameState e{std::string{end}};
-  Move m{std::string{move}};
+  Move m = s.parseMove(std::string{move});
   s.executeMove(m);
   assertEquals(s, e, std::string{msg} + " (make move)");
-  s.undoMove();
+  s.undoMove(m);
   assertEquals(s, GameState{std::string{start}},
                std::string{msg} + " (unmake move)");
 }
@@ -236,10 +401,40 @@ void makeMove() {
                   "8/8/8/8/8/2p5/8/8 w - - 0 1", "en passant capture");
   assertMoveMaker("8/8/8/8/8/8/8/R3K3 w Q - 0 1", "e1c1",
                   "8/8/8/8/8/8/8/2KR4 b - - 1 1", "white queen-side castle");
+
+  GameState a{}, b{};
+  for (auto m : {"g1f3", "g8f6", "b1c3"}) a.executeMove(Move{m});
+  for (auto m : {"b1c3", "g8f6", "g1f3"}) b.executeMove(Move{m});
+  assertEquals(a.hash, b.hash, "Transpositions have the same hash");
+  GameState c{};
+  c.executeMove(Move{"e2e4"});
+  assertEquals(c.hash == GameState{}.hash, false,
+               "Different positions have different hashes");
+  GameState e3{"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1"};
+  assertEquals(e3.hash == c.hash && e3.enPassantSquare == Square::noSquare,
+               true, "An en passant square nobody can use is dropped");
+  GameState d5{"rnbqkbnr/ppp1pppp/8/8/3pP3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1"};
+  assertEquals(d5.enPassantSquare == Square::e3, true,
+               "A usable en passant square is kept");
+
+  GameState shuffle{};
+  const std::array<Move, 4> knights = {Move{"g1f3"}, Move{"g8f6"},
+                                       Move{"f3g1"}, Move{"f6g8"}};
+  for (std::size_t i = 0; i < GameState::undoCapacity; i++) {
+    shuffle.executeMove(knights[i % knights.size()]);
+  }
+  bool full = false;
+  try {
+    shuffle.executeMove(knights[0]);
+  } catch (const std::length_error&) {
+    full = true;
+  }
+  assertEquals(full, true, "A full undo stack is reported in every build");
 }
 
 void perft(GameState& start, std::vector<std::uint64_t>& results, int depth) {
-  auto moves = start.generateLegalMoves();
+  MoveList moves;
+  start.generateLegalMoves(moves);
 
   results[results.size() - depth] += moves.size();
   if (depth <= 1) {
@@ -249,7 +444,23 @@ void perft(GameState& start, std::vector<std::uint64_t>& results, int depth) {
   for (Move m : moves) {
     start.executeMove(m);
     perft(start, results, depth - 1);
-    start.undoMove();
+    start.undoMove(m);
+  }
+}
+
+/// @brief Like `perft` above, but with copy-make instead of make/unmake.
+void perft(const Position& start, std::vector<std::uint64_t>& results,
+           int depth) {
+  MoveList moves;
+  start.generateLegalMoves(moves);
+
+  results[results.size() - depth] += moves.size();
+  if (depth <= 1) {
+    return;
+  }
+
+  for (Move m : moves) {
+    perft(start.apply(m), results, depth - 1);
   }
 }
 
@@ -257,16 +468,62 @@ std::uint64_t simplePerft(GameState& start, int depth) {
   if (depth <= 0) {
     return 1;
   }
-  auto moves = start.generateLegalMoves();
+  MoveList moves;
+  start.generateLegalMoves(moves);
   std::uint64_t counter = 0;
   for (Move m : moves) {
     start.executeMove(m);
     counter += simplePerft(start, depth - 1);
-    start.undoMove();
+    start.undoMove(m);
+  }
+  return counter;
+}
+
+std::uint64_t simplePerft(const Position& start, int depth) {
+  if (depth <= 0) {
+    return 1;
+  }
+  MoveList moves;
+  start.generateLegalMoves(moves);
+  std::uint64_t counter = 0;
+  for (Move m : moves) {
+    counter += simplePerft(start.apply(m), depth - 1);
   }
   return counter;
 }
 
+/// @brief Perft through pseudo-legal generation and `isLegal`.
+std::uint64_t pseudoLegalPerft(const Position& position, int depth) {
+  if (depth <= 0) {
+    return 1;
+  }
+  MoveList moves;
+  position.generatePseudoLegalMoves<GenerationMode::all>(moves);
+  std::uint64_t counter = 0;
+  for (Move m : moves) {
+    if (position.isLegal(m)) {
+      counter += pseudoLegalPerft(position.apply(m), depth - 1);
+    }
+  }
+  return counter;
+}
+
+void lazyLegality() {
+  header("Lazy Legality Checks");
+  for (const auto& fen : benchPositions) {
+    const Position& position = GameState{fen};
+    assertEquals(pseudoLegalPerft(position, 3), simplePerft(position, 3),
+                 "Pseudo-legal moves filtered by isLegal give the same perft");
+  }
+  for (auto fen : {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+                   "8/8/8/K1pP3q/8/8/8/7k w - c6 0 1",
+                   "8/8/8/8/8/p3k2p/P2r3P/R3K2R w KQ - 0 1"}) {
+    const Position& position = GameState{fen};
+    assertEquals(pseudoLegalPerft(position, 4), simplePerft(position, 4),
+                 "Pins, en passant and castling are checked lazily");
+  }
+}
+
 void divide(GameState& start, int depth) {
   auto moves = start.generateLegalMoves();
   std::uint64_t counter = 0;
@@ -274,7 +531,7 @@ void divide(GameState& start, int depth) {
     std::cerr << m << ": ";
     start.executeMove(m);
     std::uint64_t p = simplePerft(start, depth - 1);
-    start.undoMove();
+    start.undoMove(m);
     counter += p;
     std::cerr << p << '\n';
   }
@@ -285,7 +542,11 @@ void assertPerft(std::string_view start, std::vector<std::uint64_t> expected,
                  std::string_view msg) {
   GameState s{std::string{start}};
   std::vector<std::uint64_t> results(expected.size());
-  perft(s, results, results.size());
+  if constexpr (copyMake) {
+    perft(static_cast<const Position&>(s), results, results.size());
+  } else {
+    perft(s, results, results.size());
+  }
   assertEquals(results, expected, msg);
 }
 
@@ -301,6 +562,8 @@ void perftTest() {
       "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
       {48, 2039, 97862, 4085603, 193690690, 8031647685},
       "Kiwipete by Peter McKenzie");
+  assertPerft("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+              {14, 191, 2812, 43238, 674624, 11030083}, "pos 3");
   assertPerft(
       "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
       {6, 264, 9467, 422333, 15833292, 706045033}, "pos 4");
@@ -313,6 +576,738 @@ void perftTest() {
       "pos 6  Steven Edwards");
 }
 
+/// @brief Collects the `info` lines of the search output that belong to the
+/// given iteration.
+std::vector<std::string> infoLines(const std::string& output, int depth) {
+  std::istringstream in{output};
+  std::string prefix = "info depth " + std::to_string(depth) + " ";
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(in, line);) {
+    if (line.rfind(prefix, 0) == 0) lines.push_back(line);
+  }
+  return lines;
+}
+
+/// @return the percentage of hits among the probes of a hash table.
+double hitRate(std::uint64_t hits, std::uint64_t probes) {
+  return 100.0 * static_cast<double>(hits) /
+         static_cast<double>(std::max<std::uint64_t>(probes, 1));
+}
+
+void bench(int depth) {
+  std::ostream noOutput{nullptr};
+  Search::Searcher searcher{};
+  std::uint64_t nodes = 0, pawnProbes = 0, pawnHits = 0, evalProbes = 0,
+                evalHits = 0, evaluations = 0, lazyExits = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (const auto& fen : benchPositions) {
+    GameState state{fen};
+    Move best = searcher.search(state, {1, depth}, noOutput);
+    std::cout << fen << ": " << best << ", " << searcher.nodes()
+              << " nodes, pawn hash hits "
+              << hitRate(searcher.pawns().hits(), searcher.pawns().probes())
+              << "%, eval cache hits "
+              << hitRate(searcher.evals().hits(), searcher.evals().probes())
+              << "%, lazy exits "
+              << hitRate(searcher.evals().lazyExits(),
+                         searcher.evals().evaluations())
+              << "%\n";
+    nodes += searcher.nodes();
+    pawnProbes += searcher.pawns().probes();
+    pawnHits += searcher.pawns().hits();
+    evalProbes += searcher.evals().probes();
+    evalHits += searcher.evals().hits();
+    evaluations += searcher.evals().evaluations();
+    lazyExits += searcher.evals().lazyExits();
+  }
+  auto time = std::chrono::steady_clock::now() - start;
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(time).count();
+  std::cout << "Nodes: " << nodes << "\nTime:  " << ms << " ms\nNPS:   "
+            << (nodes * 1000 / std::max<std::uint64_t>(ms, 1))
+            << "\nPawn hash hits: " << hitRate(pawnHits, pawnProbes)
+            << "%\nEval cache hits: " << hitRate(evalHits, evalProbes)
+            << "%\nLazy exits: " << hitRate(lazyExits, evaluations) << "%\n";
+}
+
+/// @brief Runs `simplePerft` for `state` and prints its speed.
+template <typename State>
+std::uint64_t timePerft(State& state, int depth, std::string_view name) {
+  auto start = std::chrono::steady_clock::now();
+  std::uint64_t nodes = simplePerft(state, depth);
+  auto time = std::chrono::steady_clock::now() - start;
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+  std::cout << "  " << name << ": " << nodes << " nodes, " << (us / 1000)
+            << " ms, " << (nodes * 1'000'000 / std::max<std::int64_t>(us, 1))
+            << " nodes/s\n";
+  return nodes;
+}
+
+void perftBench(int depth) {
+  for (const auto& fen : benchPositions) {
+    std::cout << fen << '\n';
+    GameState state{fen};
+    timePerft(state, depth, "make/unmake");
+    const Position& position = state;
+    timePerft(position, depth, "copy-make  ");
+  }
+  std::cout << "This build uses " << (copyMake ? "copy-make" : "make/unmake")
+            << " in perft.\n";
+}
+
+/// @brief Keeps the compiler from optimizing the benchmarked moves away.
+static volatile std::uint64_t benchSink = 0;
+
+void makeMoveBench(int repetitions) {
+  for (const auto& fen : benchPositions) {
+    GameState state{fen};
+    MoveList moves;
+    state.generateLegalMoves(moves);
+    std::uint64_t checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; i++) {
+      for (Move m : moves) {
+        state.executeMove(m);
+        checksum ^= state.hash;
+        state.undoMove(m);
+      }
+    }
+    auto time = std::chrono::steady_clock::now() - start;
+    auto ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+
+    const Position& position = state;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; i++) {
+      for (Move m : moves) {
+        checksum ^= position.apply(m).hash;
+      }
+    }
+    time = std::chrono::steady_clock::now() - start;
+    auto copyNs =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+
+    auto pairs = std::max<std::int64_t>(
+        static_cast<std::int64_t>(moves.size()) * repetitions, 1);
+    std::cout << fen << '\n'
+              << "  make/unmake: " << (ns / pairs) << " ns per move\n"
+              << "  copy-make  : " << (copyNs / pairs) << " ns per move\n";
+    benchSink = checksum;
+  }
+}
+
+void parallelPerftBench(int depth, unsigned threadCount) {
+  std::atomic<std::uint64_t> nodes{0};
+  auto work = [&nodes, depth]() {
+    for (const auto& fen : benchPositions) {
+      nodes += simplePerft(static_cast<const Position&>(GameState{fen}), depth);
+    }
+  };
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < threadCount; i++) {
+    threads.emplace_back(work);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto time = std::chrono::steady_clock::now() - start;
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(time).count();
+  std::cout << threadCount << " threads: " << nodes << " nodes, " << ms
+            << " ms, " << (nodes * 1000 / std::max<std::int64_t>(ms, 1))
+            << " nodes/s\n";
+}
+
+/// @brief Counts the positions below `state` whose incrementally updated
+/// piece-square score differs from a recomputation, after making a move and
+/// after taking it back.
+unsigned pieceSquareErrors(GameState& state, int depth) {
+  unsigned errors = state.psqt != Eval::pieceSquareScore(state);
+  if (depth <= 0) {
+    return errors;
+  }
+  for (Move m : state.generateLegalMoves()) {
+    state.executeMove(m);
+    errors += pieceSquareErrors(state, depth - 1);
+    state.undoMove(m);
+    errors += state.psqt != Eval::pieceSquareScore(state);
+  }
+  return errors;
+}
+
+void evaluation() {
+  header("Evaluation");
+  assertEquals(Eval::eval(GameState{}), 0,
+               "The starting position is balanced");
+  assertEquals(
+      Eval::eval(GameState{
+          "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1"}),
+      Eval::eval(GameState{
+          "rnbqkbnr/pppp1ppp/8/4p3/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"}),
+      "The evaluation is symmetric");
+  assertEquals(Eval::midgame(Eval::makeScore(-3, 5)), -3,
+               "Packed scores keep the midgame value");
+  assertEquals(Eval::endgame(Eval::makeScore(-3, 5) - Eval::makeScore(2, 9)),
+               -4, "Packed scores add up like their values");
+  for (const auto& fen : benchPositions) {
+    GameState state{fen};
+    assertEquals(pieceSquareErrors(state, 3), 0U,
+                 "The piece-square score is kept up to date");
+  }
+}
+
+/// @brief Whether a lazy evaluation in the window `(alpha, beta)` is exact
+/// or on the same side of the window as the full evaluation.
+bool lazyAgrees(int lazy, int full, int alpha, int beta) {
+  return lazy == full || (lazy <= alpha && full <= alpha) ||
+         (lazy >= beta && full >= beta);
+}
+
+/// @brief Counts the positions and windows in the tree below `state` where
+/// the lazy evaluation does not agree with the full evaluation.
+unsigned lazyEvalErrors(GameState& state, int depth) {
+  int full = Eval::eval(state);
+  unsigned errors = 0;
+  for (int alpha : {-2000, -600, -250, -50, 0, 100, 400, 1500}) {
+    for (int width : {1, 100, 500}) {
+      int beta = alpha + width;
+      errors += !lazyAgrees(Eval::eval(state, alpha, beta), full, alpha, beta);
+    }
+  }
+  // null windows close to the full evaluation, where a margin that is too
+  // small shows first
+  for (int offset : {-700, -400, -200, -100, -30, -3, 0, 2, 29, 99, 399}) {
+    int alpha = full + offset;
+    int beta = alpha + 1;
+    errors += !lazyAgrees(Eval::eval(state, alpha, beta), full, alpha, beta);
+  }
+  if (depth <= 0) {
+    return errors;
+  }
+  for (Move m : state.generateLegalMoves()) {
+    state.executeMove(m);
+    errors += lazyEvalErrors(state, depth - 1);
+    state.undoMove(m);
+  }
+  return errors;
+}
+
+void lazyEvaluation() {
+  header("Lazy evaluation");
+  GameState queenUp{"4k3/8/8/8/8/8/8/3QK3 w - - 0 1"};
+  assertEquals(Eval::eval(queenUp, -inf, inf), Eval::eval(queenUp),
+               "The lazy evaluation with an infinite window is exact");
+  assertEquals(Eval::eval(queenUp, -100, 100) >= 100, true,
+               "A lazy evaluation above the window stays above it");
+  for (const auto& fen : benchPositions) {
+    GameState state{fen};
+    assertEquals(lazyEvalErrors(state, 2), 0U,
+                 "Lazy exits agree with the full evaluation");
+  }
+  // Many passed pawns add more than any fixed margin would allow for.
+  for (const char* fen : {"7k/PPPPP3/8/8/8/8/8/R5K1 w - - 0 1",
+                          "r5k1/8/8/8/8/8/ppppp3/7K b - - 0 1",
+                          "6k1/PPPPPP2/8/8/8/8/8/6K1 b - - 0 1"}) {
+    GameState state{fen};
+    int full = Eval::eval(state);
+    unsigned errors = 0;
+    for (int alpha = full - 3000; alpha <= full + 3000; alpha++) {
+      errors += !lazyAgrees(Eval::eval(state, alpha, alpha + 1), full, alpha,
+                            alpha + 1);
+    }
+    assertEquals(errors, 0U,
+                 "Lazy exits agree in all windows with many passed pawns");
+  }
+
+  // In quiescence, the stand pat is mostly evaluated with a null window
+  // near the score of the position before a capture.
+  Eval::PawnTable pawnTable;
+  Eval::EvalCache cache;
+  GameState rookUp{"rnbqkbn1/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQq - 0 1"};
+  Eval::eval(rookUp, pawnTable, cache, 0, 1);
+  assertEquals(cache.lazyExits(), std::uint64_t{1},
+               "A rook up in the middlegame, a null window at 0 exits early");
+  GameState pawnUp{"rnbqkbnr/ppp1pppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"};
+  Eval::eval(pawnUp, pawnTable, cache, 0, 1);
+  assertEquals(cache.lazyExits(), std::uint64_t{1},
+               "A pawn up, a null window at 0 needs the full evaluation");
+}
+
+void material() {
+  header("Material");
+  GameState start{};
+  assertEquals(Eval::pieceCount(start.materialKey, Piece::pawn, Color::black),
+               8, "The material key counts the pieces");
+  assertEquals(Eval::pieceCount(start.materialKey, Piece::queen, Color::white),
+               1, "The material key counts the queens");
+  assertEquals(static_cast<int>(Eval::materialEntry(start.materialKey).phase),
+               Eval::midgamePhase, "The starting position is the midgame");
+  GameState promoted{"4k3/8/8/8/8/8/8/QQQNK3 w - - 0 1"};
+  assertEquals(Eval::materialEntry(promoted.materialKey).scale ==
+                   Eval::computeMaterial(promoted.materialKey).scale,
+               true, "Promoted material is computed on the fly");
+  for (const auto& fen : benchPositions) {
+    GameState state{fen};
+    Eval::MaterialEntry entry = Eval::materialEntry(state.materialKey);
+    Eval::MaterialEntry computed = Eval::computeMaterial(state.materialKey);
+    assertEquals(entry.phase == computed.phase && entry.scale == computed.scale,
+                 true, "The material table agrees with the computation");
+  }
+
+  for (const auto& fen : {"8/8/4k3/8/8/4K3/8/8 w - - 0 1",
+                          "8/8/4k3/8/8/3NK3/8/8 w - - 0 1",
+                          "8/8/4k3/8/8/3bK3/8/8 w - - 0 1",
+                          "8/8/2b1k3/8/8/3BK3/8/8 b - - 0 1"}) {
+    GameState state{fen};
+    assertEquals(Eval::isDeadDraw(state) && Eval::eval(state) == 0, true,
+                 "Neither side can mate");
+  }
+  GameState oppositeBishops{"8/8/3bk3/8/8/3BK3/8/8 w - - 0 1"};
+  assertEquals(Eval::isDeadDraw(oppositeBishops), false,
+               "Opposite colored bishops can still mate");
+  GameState twoKnights{"8/8/4k3/8/8/2NNK3/8/8 w - - 0 1"};
+  assertEquals(Eval::isDeadDraw(twoKnights), false,
+               "Two knights can mate if the opponent blunders");
+  assertEquals(Eval::eval(twoKnights) < Piece::worth[Piece::pawn], true,
+               "Two knights cannot force mate");
+
+  std::ostringstream info;
+  GameState bishop{"8/8/4k3/8/8/3BK3/8/8 w - - 0 1"};
+  Search::search(bishop, {1, 4}, info);
+  assertEquals(info.str().find("score cp 0 nodes") != std::string::npos, true,
+               "The search sees dead draws");
+}
+
+/// @brief The FEN of a king and pawn against king position.
+std::string kpkFen(Color::t strong, Color::t us, Square::t strongKing,
+                   Square::t pawn, Square::t weakKing) {
+  auto name = [strong](Square::t square, char piece) {
+    return std::make_pair(square, strong == Color::white
+                                      ? piece
+                                      : static_cast<char>(piece + 'a' - 'A'));
+  };
+  std::array<std::pair<Square::t, char>, 3> pieces = {
+      name(strongKing, 'K'), name(pawn, 'P'),
+      std::make_pair(weakKing, strong == Color::white ? 'k' : 'K')};
+  std::string fen;
+  for (Coord::t rank = Coord::width - 1; rank >= 0; rank--) {
+    int empty = 0;
+    for (Coord::t file = 0; file < Coord::width; file++) {
+      auto piece = std::find_if(pieces.begin(), pieces.end(), [&](auto p) {
+        return p.first == Square::index(file, rank);
+      });
+      if (piece == pieces.end()) {
+        empty++;
+        continue;
+      }
+      if (empty > 0) fen += std::to_string(empty);
+      empty = 0;
+      fen += piece->second;
+    }
+    if (empty > 0) fen += std::to_string(empty);
+    if (rank > 0) fen += '/';
+  }
+  return fen + (us == Color::white ? " w" : " b") + " - - 0 1";
+}
+
+/// @brief Counts the random legal KPK positions whose bitbase result does
+/// not follow from the results of their successors: the side with the pawn
+/// wins if one of its moves wins, the other side loses if all of its moves
+/// lose (or it is mated).
+unsigned kpkErrors(int samples) {
+  std::mt19937 random{48};
+  std::uniform_int_distribution<int> square{0, Square::size - 1};
+  std::uniform_int_distribution<int> color{0, 1};
+  auto wins = [](const Position& position, Color::t strong) {
+    if (position.materialKey != Eval::materialKey(Piece::pawn, strong)) {
+      return false;
+    }
+    Color::t weak = Color::opponent(strong);
+    return KPK::probe(
+        strong, position.us(),
+        position.forPiece(Piece::king, strong).findFirstSet(),
+        position.forPiece(Piece::pawn).findFirstSet(),
+        position.forPiece(Piece::king, weak).findFirstSet());
+  };
+  unsigned errors = 0;
+  for (int tested = 0; tested < samples;) {
+    auto strong = static_cast<Color::t>(color(random));
+    auto us = static_cast<Color::t>(color(random));
+    auto strongKing = static_cast<Square::t>(square(random));
+    auto pawn = static_cast<Square::t>(square(random));
+    auto weakKing = static_cast<Square::t>(square(random));
+    Coord::t pawnRank = Square::rank(Square::reverseForColor(pawn, strong));
+    // promotions leave the bitbase
+    bool promotes = us == strong && pawnRank == Coord::width - 2;
+    if (strongKing == pawn || weakKing == pawn || strongKing == weakKing ||
+        pawnRank == 0 || pawnRank == Coord::width - 1 || promotes ||
+        MoveTables::kingMoves(strongKing).isSet(weakKing) ||
+        (us == strong &&
+         MoveTables::pawnAttacks(strong, pawn).isSet(weakKing))) {
+      continue;
+    }
+    tested++;
+    Position position{kpkFen(strong, us, strongKing, pawn, weakKing)};
+    MoveList moves;
+    position.generateLegalMoves(moves);
+    bool expected = us != strong;
+    for (Move m : moves) {
+      bool successorWins = wins(position.apply(m), strong);
+      if (us == strong) {
+        expected |= successorWins;
+      } else {
+        expected &= successorWins;
+      }
+    }
+    if (us != strong && moves.size() == 0) {
+      expected = position.isCheck();
+    }
+    if (wins(position, strong) != expected) errors++;
+  }
+  return errors;
+}
+
+void kingPawnKing() {
+  header("King and pawn against king");
+  assertEquals(kpkErrors(20000), 0u,
+               "The bitbase agrees with the positions one move ahead");
+
+  GameState ahead{"4k3/8/4K3/4P3/8/8/8/8 b - - 0 1"};
+  assertEquals(Eval::eval(ahead) <= -Piece::worth[Piece::rook], true,
+               "The king in front of the pawn on the sixth rank wins");
+  GameState stalemate{"4k3/4P3/4K3/8/8/8/8/8 b - - 0 1"};
+  assertEquals(Eval::eval(stalemate), 0, "The defending king is stalemated");
+  GameState whiteToMove{"4k3/4P3/4K3/8/8/8/8/8 w - - 0 1"};
+  assertEquals(Eval::eval(whiteToMove) >= Piece::worth[Piece::rook], true,
+               "Without the stalemate, the pawn promotes");
+  GameState rookPawn{"k7/8/K7/P7/8/8/8/8 w - - 0 1"};
+  assertEquals(Eval::eval(rookPawn), 0,
+               "A rook pawn does not win against the king in the corner");
+  GameState blackPawn{"8/8/8/8/3p4/3k4/8/3K4 w - - 0 1"};
+  assertEquals(Eval::eval(blackPawn) <= -Piece::worth[Piece::rook], true,
+               "The bitbase is mirrored for black pawns");
+  GameState capture{"8/8/8/8/8/3k4/3P4/7K b - - 0 1"};
+  assertEquals(Eval::eval(capture), 0, "An undefended pawn is lost");
+
+  std::ostringstream info;
+  GameState opposition{"8/8/4k3/8/4P3/4K3/8/8 w - - 0 1"};
+  Search::search(opposition, {1, 4}, info);
+  assertEquals(info.str().find("score cp 0 nodes") != std::string::npos, true,
+               "The search knows the draw without the opposition");
+}
+
+void tablebases() {
+  header("Tablebases");
+  GameState won{"4k3/8/4K3/4P3/8/8/8/8 w - - 0 1"};
+  assertEquals(Tablebases::probeWDL(won) == Tablebases::WDL::win, true,
+               "The built-in KPK bitbase is probed");
+  GameState lost{"4k3/8/4K3/4P3/8/8/8/8 b - - 0 1"};
+  assertEquals(Tablebases::probeWDL(lost) == Tablebases::WDL::loss, true,
+               "The result is for the side to move");
+  assertEquals(Tablebases::probeWDL(GameState{}).has_value(), false,
+               "Positions with many pieces are not covered");
+  GameState castling{"4k3/8/8/8/8/8/4P3/4K2R w K - 0 1"};
+  assertEquals(Tablebases::probeWDL(castling).has_value(), false,
+               "Positions with castling rights are not covered");
+
+  std::string directory = "dagor-test-tablebases";
+  std::filesystem::create_directory(directory);
+  for (const char* name : {"KQvKR.dtb", "KRvK.txt", "KQRvKR.rtbw"}) {
+    std::ofstream{directory + "/" + name} << "not a table";
+  }
+  assertEquals(Tablebases::init("/nonexistent:" + directory), std::size_t{1},
+               "Tables are found by their names");
+  assertEquals(Tablebases::largest(), 4,
+               "The largest table decides which positions are probed");
+  Tablebases::init("");
+  std::filesystem::remove_all(directory);
+  assertEquals(Tablebases::largest(), 3, "Only the built-in tables are left");
+
+  std::ostringstream info;
+  GameState capture{"4k3/8/3nK3/4P3/8/8/8/8 w - - 0 1"};
+  Search::search(capture, {1, 3}, info);
+  assertEquals(info.str().find("score cp 19999 nodes") != std::string::npos,
+               true, "The search sees the capture into a won endgame");
+  assertEquals(info.str().find("tbhits 0") == std::string::npos, true,
+               "The search reports the tablebase hits");
+  won.executeMove(Search::search(won, {1, 3}, info));
+  assertEquals(Tablebases::probeWDL(won) == Tablebases::WDL::loss, true,
+               "The search keeps the win");
+}
+
+void tablebaseGenerator() {
+  header("Tablebase generator");
+  std::string directory = "dagor-test-gentb";
+  std::filesystem::create_directory(directory);
+  std::ostringstream log;
+  assertEquals(Tablebases::generate("KPvK", directory, 2, log), true,
+               "A table is generated");
+  assertEquals(Tablebases::generate("KvK", directory, 2, log) ||
+                   Tablebases::generate("KQRvKR", directory, 2, log),
+               false, "Only tables of 3 to 4 pieces are generated");
+  assertEquals(log.str().find("KRvK: 87584 wins, 11122 draws, 100850 losses, "
+                              "longest mate in 32 plies") != std::string::npos,
+               true, "The tables after promotions are generated first");
+  assertEquals(Tablebases::init(directory), std::size_t{5},
+               "The generated tables are found");
+
+  unsigned errors = 0;
+  for (Color::t us : Color::all) {
+    for (Square::t strongKing = 0; strongKing < Square::size; strongKing++) {
+      for (Square::t pawn = Square::a2; pawn < Square::a8; pawn++) {
+        for (Square::t weakKing = 0; weakKing < Square::size; weakKing++) {
+          if (strongKing == pawn || weakKing == pawn ||
+              strongKing == weakKing ||
+              MoveTables::kingMoves(strongKing).isSet(weakKing) ||
+              (us == Color::white &&
+               MoveTables::pawnAttacks(Color::white, pawn).isSet(weakKing))) {
+            continue;
+          }
+          Position position{
+              kpkFen(Color::white, us, strongKing, pawn, weakKing)};
+          auto bitbase = Tablebases::probeKPK(position);
+          auto plies = Tablebases::probeDTM(position);
+          if (!plies || (*plies > 0) != (*bitbase == Tablebases::WDL::win) ||
+              (*plies < 0 && *bitbase != Tablebases::WDL::loss)) {
+            errors++;
+          }
+        }
+      }
+    }
+  }
+  assertEquals(errors, 0u, "The generated KPK table agrees with the bitbase");
+
+  GameState mateInOne{"7k/8/6K1/8/8/8/8/Q7 w - - 0 1"};
+  assertEquals(Tablebases::probeDTM(mateInOne) == 1, true,
+               "The tables know the distance to mate");
+  GameState swapped{"q7/8/8/8/8/6k1/8/7K b - - 0 1"};
+  assertEquals(Tablebases::probeDTM(swapped) == 1, true,
+               "A table serves both colors");
+  GameState mated{"7k/6Q1/6K1/8/8/8/8/8 b - - 0 1"};
+  assertEquals(Tablebases::probeWDL(mated) == Tablebases::WDL::loss &&
+                   Tablebases::probeDTM(mated) == 0,
+               true, "Mated positions are lost in 0 plies");
+
+  GameState rook{"8/8/8/4k3/8/8/8/R3K3 w - - 0 1"};
+  int plies = *Tablebases::probeDTM(rook);
+  std::ostringstream info;
+  rook.executeMove(Search::search(rook, {1, 2}, info));
+  assertEquals(Tablebases::probeDTM(rook) == 1 - plies, true,
+               "The search plays the fastest mate");
+
+  GameState capture{"3k4/8/8/8/8/8/3r4/3Q2K1 w - - 0 1"};
+  plies = *Tablebases::probeDTM(GameState{"3k4/8/8/8/8/8/3Q4/6K1 b - - 0 1"});
+  Search::search(capture, {1, 2}, info);
+  std::string score = "score cp " + std::to_string(20000 - 1 + plies) + " ";
+  assertEquals(info.str().find(score) != std::string::npos, true,
+               "The search scores wins in the tree by the distance to mate");
+
+  // Swap the second and third block offsets after the 64-byte header, so
+  // that the file keeps its size.
+  std::string corrupt = "dagor-test-gentb-corrupt";
+  std::filesystem::create_directory(corrupt);
+  std::ifstream in{directory + "/KQvK.dtb", std::ios::binary};
+  std::string table{std::istreambuf_iterator<char>{in}, {}};
+  std::swap_ranges(table.begin() + 68, table.begin() + 72,
+                   table.begin() + 72);
+  std::ofstream{corrupt + "/KQvK.dtb", std::ios::binary} << table;
+  Tablebases::init(corrupt);
+  assertEquals(Tablebases::probeDTM(mateInOne).has_value(), false,
+               "A table whose block offsets do not grow is not probed");
+
+  Tablebases::init("");
+  std::filesystem::remove_all(directory);
+  std::filesystem::remove_all(corrupt);
+}
+
+void pawnStructure() {
+  header("Pawn structure");
+  GameState knightMove{};
+  knightMove.executeMove(Move{"g1f3"});
+  assertEquals(knightMove.pawnKey, GameState{}.pawnKey,
+               "Only pawns change the pawn key");
+  GameState pawnMove{};
+  pawnMove.executeMove(Move{"e2e4"});
+  assertEquals(pawnMove.pawnKey == GameState{}.pawnKey, false,
+               "Pawn moves change the pawn key");
+
+  GameState passer{"4k3/6p1/8/3p4/8/8/P4P2/4K3 w - - 0 1"};
+  Eval::PawnEntry entry = Eval::evaluatePawns(passer);
+  assertEquals(entry.passed[Color::white],
+               BitBoards::single(Square::byName('a', '2')),
+               "A pawn without opposing pawns in front is passed");
+  assertEquals(entry.passed[Color::black],
+               BitBoards::single(Square::byName('d', '5')),
+               "Passed pawns of black");
+  assertEquals(entry.attacks[Color::white],
+               BitBoards::single(Square::byName('b', '3')) |
+                   BitBoards::single(Square::byName('e', '3')) |
+                   BitBoards::single(Square::byName('g', '3')),
+               "The entry holds the pawn attacks");
+  GameState doubled{"4k3/2ppp3/8/8/8/4P3/3PP3/4K3 w - - 0 1"};
+  GameState healthy{"4k3/2ppp3/8/8/8/2P5/3PP3/4K3 w - - 0 1"};
+  assertEquals(Eval::endgame(Eval::evaluatePawns(doubled).score) <
+                   Eval::endgame(Eval::evaluatePawns(healthy).score),
+               true, "Doubled pawns are worth less");
+
+  Eval::PawnTable table{64};
+  for (const auto& fen : benchPositions) {
+    GameState state{fen};
+    table.probe(state);
+    assertEquals(table.probe(state).score, Eval::evaluatePawns(state).score,
+                 "The pawn table returns the structure's entry");
+    assertEquals(Eval::eval(state, table), Eval::eval(state),
+                 "The pawn table does not change the evaluation");
+  }
+  assertEquals(table.hits(),
+               static_cast<std::uint64_t>(2 * benchPositions.size()),
+               "Probing a structure again is a hit");
+}
+
+void evalCache() {
+  header("Evaluation cache");
+  Eval::EvalCache cache{1};
+  assertEquals(cache.size(), static_cast<std::size_t>(128),
+               "The cache has a power of two entries");
+  int value = 0;
+  cache.store(0x123456789abcdef0, -321);
+  assertEquals(cache.probe(0x123456789abcdef0, value) && value == -321, true,
+               "A stored evaluation is found");
+  assertEquals(cache.probe(0x923456789abcdef0, value), false,
+               "Another position with the same index misses");
+  Eval::EvalCache disabled{0};
+  disabled.store(0x123456789abcdef0, 1);
+  assertEquals(disabled.probe(0x123456789abcdef0, value), false,
+               "A cache of size 0 is disabled");
+
+  Eval::PawnTable pawns{};
+  cache.resetStatistics();
+  for (const auto& fen : benchPositions) {
+    GameState state{fen};
+    Eval::eval(state, pawns, cache, -inf, inf);
+    assertEquals(Eval::eval(state, pawns, cache, -inf, inf), Eval::eval(state),
+                 "Cached evaluations are exact");
+  }
+  assertEquals(cache.hits(), static_cast<std::uint64_t>(benchPositions.size()),
+               "Evaluating a position again is a hit");
+
+  std::ostringstream cached, uncached;
+  GameState kiwipete{benchPositions[1]};
+  Search::search(kiwipete, {1, 4}, cached);
+  Search::search(kiwipete, {1, 4, 0}, uncached);
+  assertEquals(cached.str(), uncached.str(),
+               "The cache does not change the search");
+}
+
+/// @brief Counts the positions in the tree below `state` whose incrementally
+/// updated accumulator differs from one computed from scratch.
+unsigned accumulatorErrors(GameState& state, int depth) {
+  NNUE::Accumulator refreshed;
+  NNUE::refresh(state, refreshed);
+  unsigned errors = refreshed.values != state.accumulator()->values;
+  if (depth <= 0) {
+    return errors;
+  }
+  for (Move m : state.generateLegalMoves()) {
+    state.executeMove(m);
+    errors += accumulatorErrors(state, depth - 1);
+    state.undoMove(m);
+  }
+  return errors;
+}
+
+void nnue() {
+  header("NNUE");
+  NNUE::enable(true);
+  assertEquals(Eval::eval(GameState{}), 0,
+               "The built-in network sees the starting position as balanced");
+  assertEquals(
+      Eval::eval(GameState{
+          "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1"}),
+      Eval::eval(GameState{
+          "rnbqkbnr/pppp1ppp/8/4p3/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"}),
+      "The network's evaluation is symmetric");
+  for (const auto& fen : benchPositions) {
+    GameState state{fen};
+    int average = (Eval::midgame(state.psqt) + Eval::endgame(state.psqt)) / 2;
+    if (state.us() == Color::black) average = -average;
+    // each piece's weight is rounded to a multiple of two centipawns
+    assertEquals(std::abs(Eval::eval(state) - average) <= 32, true,
+                 "The built-in network reproduces the piece-square scores");
+    std::vector<NNUE::Accumulator> accumulators(4);
+    state.attachAccumulators(accumulators.data());
+    assertEquals(accumulatorErrors(state, 3), 0U,
+                 "The accumulators are kept up to date");
+    GameState copy{state};
+    assertEquals(copy.accumulator() == nullptr, true,
+                 "A copy does not share the accumulators");
+  }
+
+  auto net = std::make_unique<NNUE::Network>(NNUE::defaultNetwork());
+  std::mt19937 random{42};
+  std::uniform_int_distribution<int> weight{-128, 127}, activation{0, 127};
+  for (auto& w : net->hiddenWeights) {
+    w = static_cast<std::int8_t>(weight(random));
+  }
+  std::array<std::uint8_t, 2 * NNUE::l1> input;
+  for (auto& a : input) a = static_cast<std::uint8_t>(activation(random));
+  std::array<std::int32_t, NNUE::l2> dispatched, scalar;
+  NNUE::hiddenLayer(*net, input, dispatched);
+  NNUE::hiddenLayerScalar(*net, input, scalar);
+  assertEquals(std::vector<int>(dispatched.begin(), dispatched.end()),
+               std::vector<int>(scalar.begin(), scalar.end()),
+               "The vectorized hidden layer agrees with the scalar one");
+
+  GameState kiwipete{benchPositions[1]};
+  int builtIn = Eval::eval(kiwipete);
+  std::ostream noOutput{nullptr};
+  Search::search(kiwipete, {1, 3}, noOutput);
+  assertEquals(kiwipete.accumulator() == nullptr, true,
+               "The search takes its accumulators with it");
+  std::string path = "dagor-test.nnue";
+  assertEquals(NNUE::save(path) && NNUE::load(path), true,
+               "A saved network can be loaded");
+  assertEquals(Eval::eval(kiwipete), builtIn,
+               "The loaded network evaluates like the saved one");
+  assertEquals(NNUE::load("src/main.cpp"), false,
+               "Files that are no networks are rejected");
+  NNUE::useDefault();
+  std::remove(path.c_str());
+  NNUE::enable(false);
+}
+
+void searchTest() {
+  header("Search");
+  GameState start{};
+  std::ostringstream info;
+  Search::search(start, {3, 2}, info);
+  assertEquals(infoLines(info.str(), 2).size(), static_cast<std::size_t>(3),
+               "MultiPV reports one line per principal variation");
+  assertEquals(start, GameState{}, "Search restores the position");
+
+  GameState mate{"6k1/5ppp/8/8/8/8/8/R6K w - - 0 1"};
+  std::ostringstream mateInfo;
+  assertEquals(Search::search(mate, {2, 2}, mateInfo), Move{"a1a8"},
+               "MultiPV returns the best line's move");
+  std::string firstLine = infoLines(mateInfo.str(), 2).front();
+  assertEquals(firstLine.rfind("info depth 2 multipv 1 score mate 1 ", 0),
+               static_cast<std::size_t>(0), "The first line is the mate");
+  assertEquals(firstLine.substr(firstLine.find(" pv ")),
+               std::string{" pv a1a8"}, "The principal variation is reported");
+
+  std::ostream noOutput{nullptr};
+  Search::Searcher searcher{};
+  GameState kiwipete{benchPositions[1]};
+  if (allocationCount == nullptr) {
+    std::cout << "(allocations are only counted by the `tests` binary)\n";
+    return;
+  }
+  std::size_t before = allocationCount();
+  searcher.search(kiwipete, {2, 4}, noOutput);
+  assertEquals(allocationCount() - before, static_cast<std::size_t>(0),
+               "Search does not allocate");
+}
+
 void test() {
   header("\nRun Test suits...\n");
   pieceMovement();
@@ -320,7 +1315,20 @@ void test() {
   moveClass();
   bitBoards();
   legalMoves();
+  checkInfo();
+  generationModes();
+  lazyLegality();
   makeMove();
+  evaluation();
+  lazyEvaluation();
+  material();
+  kingPawnKing();
+  tablebases();
+  tablebaseGenerator();
+  pawnStructure();
+  evalCache();
+  nnue();
+  searchTest();
   perftTest();
 
   if (failures == 0) {
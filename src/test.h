@@ -5,11 +5,28 @@
 #ifndef DAGOR_IN_ERAIN_TEST_H
 #define DAGOR_IN_ERAIN_TEST_H
 
+#include <cstddef>
+
 #include "game_state.h"
 
 namespace Dagor::Test {
+/// @brief The number of allocations of the calling thread so far, if the
+/// binary counts them (the `tests` binary of the Makefile), else `nullptr`.
+extern std::size_t (*allocationCount)();
+
 void test();
 void divide(GameState& start, int depth);
+/// @brief Searches a fixed set of positions and reports the search speed.
+void bench(int depth);
+/// @brief Compares the speed of make/unmake and copy-make in perft.
+void perftBench(int depth);
+/// @brief Makes and unmakes (and copy-makes) every legal move of the bench
+/// positions `repetitions` times and reports the time per move.
+void makeMoveBench(int repetitions);
+/// @brief Runs copy-make perft of the bench positions on several threads at
+/// once and reports the combined speed, to compare the slider backends when
+/// the caches are shared.
+void parallelPerftBench(int depth, unsigned threads);
 }  // namespace Dagor::Test
 
 #endif  // DAGOR_IN_ERAIN_TEST_H
@@ -4,6 +4,7 @@
 #include <array>
 #include <cctype>
 #include <cstdint>
+#include <string>
 
 namespace Dagor {
 
@@ -30,6 +31,7 @@ constexpr std::array<t, 6> all = {pawn, knight, bishop, rook, queen, king};
 constexpr std::array<t, 3> leapers = {king, pawn, knight};
 constexpr std::array<t, 3> sliders = {bishop, rook, queen};
 constexpr std::array<t, 5> nonKing = {pawn, knight, bishop, rook, queen};
+constexpr std::array<t, 4> officers = {knight, bishop, rook, queen};
 constexpr std::array<std::int16_t, Piece::all.size()> worth = {100, 325, 350,
                                                                500, 900};
 constexpr std::array<char, 7> names = {'p', 'n', 'b', 'r', 'q', 'k', '.'};
@@ -93,18 +95,13 @@ constexpr t fullRights =
 constexpr t none = 0;
 }  // namespace CastlingRights
 
-namespace MoveFlags {
+/// @brief What a move does besides moving a piece from its start to its end
+/// square. The kind is known when the move is generated, so making and
+/// unmaking a move does not need to work it out again.
+namespace MoveKind {
 using t = std::uint8_t;
-enum {
-  normal = 0,
-  whiteKingSide,
-  whiteQueenSide,
-  blackKingSide,
-  blackQueenSide,
-  enPassant,
-  promotion
-};
-}  // namespace MoveFlags
+enum : t { normal, castling, enPassant, promotion };
+}  // namespace MoveKind
 
 namespace Square {
 using t = std::int8_t;
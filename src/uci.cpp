@@ -1,12 +1,18 @@
 #include "uci.h"
 
+#include <algorithm>
+#include <charconv>
 #include <iostream>
+#include <optional>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
 #include "game_state.h"
+#include "nnue.h"
 #include "search.h"
+#include "tablebases.h"
 
 namespace Dagor::UCI {
 
@@ -24,8 +30,81 @@ std::vector<std::string> splitOnWhitespace(const std::string &input) {
   return result;
 }
 
+/// @brief The words of an option value joined again, as paths may contain
+/// spaces.
+std::string joinValue(std::vector<std::string>::const_iterator begin,
+                      std::vector<std::string>::const_iterator end) {
+  std::string value = *begin;
+  for (auto part = begin + 1; part != end; ++part) {
+    value += ' ' + *part;
+  }
+  return value;
+}
+
+/// @brief The integer of a word, or `std::nullopt` if it is none.
+std::optional<int> parseInt(const std::string &word) {
+  int value = 0;
+  const char *end = word.data() + word.size();
+  auto [last, error] = std::from_chars(word.data(), end, value);
+  if (error != std::errc{} || last != end) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+/// @brief Handles `setoption name <id> value <x>`.
+void setOption(const std::vector<std::string> &parts,
+               Search::Options &options) {
+  auto value = std::find(parts.begin(), parts.end(), "value");
+  if (parts.size() < 3 || parts[1] != "name" || value == parts.end() ||
+      value + 1 == parts.end()) {
+    std::cerr << "malformed setoption command\n";
+    return;
+  }
+  if (parts[2] == "MultiPV" || parts[2] == "EvalCache") {
+    auto number = parseInt(*(value + 1));
+    if (!number) {
+      std::cerr << "malformed value of option `" << parts[2] << "`: `"
+                << *(value + 1) << "`\n";
+    } else if (parts[2] == "MultiPV") {
+      options.multiPV = std::clamp(*number, 1, 256);
+    } else {
+      options.evalCacheKiB = std::clamp(*number, 0, 65536);
+    }
+  } else if (parts[2] == "UseNNUE") {
+    NNUE::enable(*(value + 1) == "true");
+  } else if (parts[2] == "EvalFile") {
+    std::string path = joinValue(value + 1, parts.end());
+    if (path == "<built-in>") {
+      NNUE::useDefault();
+    } else if (!NNUE::load(path)) {
+      std::cerr << "cannot load network file: `" << path << "`\n";
+    }
+  } else if (parts[2] == "TablebasePath") {
+    std::string path = joinValue(value + 1, parts.end());
+    Tablebases::init(path == "<empty>" ? "" : path);
+  } else {
+    std::cerr << "unknown option: `" << parts[2] << "`\n";
+  }
+}
+
+/// @brief Handles the arguments of `go`; only `depth` is supported so far.
+Search::Options goOptions(const std::vector<std::string> &parts,
+                          Search::Options options) {
+  auto depth = std::find(parts.begin(), parts.end(), "depth");
+  if (depth != parts.end() && depth + 1 != parts.end()) {
+    if (auto number = parseInt(*(depth + 1))) {
+      options.depth = std::max(*number, 1);
+    } else {
+      std::cerr << "malformed depth: `" << *(depth + 1) << "`\n";
+    }
+  }
+  return options;
+}
+
 void universalChessInterface(std::istream &in, std::ostream &out) {
   GameState state{};
+  Search::Options options{};
   while (true) {
     std::string line;
 
@@ -38,9 +117,17 @@ void universalChessInterface(std::istream &in, std::ostream &out) {
     } else if (parts[0] == "uci") {
       out << "id name Dagor-in-Erain\n";
       out << "id author Jakob Teuber\n";
+      out << "option name MultiPV type spin default 1 min 1 max 256\n";
+      out << "option name EvalCache type spin default "
+          << Eval::EvalCache::defaultKiB << " min 0 max 65536\n";
+      out << "option name UseNNUE type check default false\n";
+      out << "option name EvalFile type string default <built-in>\n";
+      out << "option name TablebasePath type string default <empty>\n";
       out << "uciok\n";
     } else if (parts[0] == "isready") {
       out << "readyok\n";
+    } else if (parts[0] == "setoption") {
+      setOption(parts, options);
     } else if (parts[0] == "ucinewgame") {
       // nothing
     } else if (parts[0] == "position") {
@@ -53,12 +140,18 @@ void universalChessInterface(std::istream &in, std::ostream &out) {
       }
       if (movePos != std::string::npos) {
         auto moves = line.substr(movePos + 5);
-        for (auto m : splitOnWhitespace(moves)) {
-          state.executeMove(Move{m});
+        try {
+          for (auto m : splitOnWhitespace(moves)) {
+            // these moves are never taken back
+            state.makeMove(state.parseMove(m));
+          }
+        } catch (const std::invalid_argument &error) {
+          // the position stays at the last legal move
+          std::cerr << error.what() << ", ignoring the remaining moves\n";
         }
       }
     } else if (parts[0] == "go") {
-      auto move = Search::search(state);
+      auto move = Search::search(state, goOptions(parts, options), out);
       out << "bestmove " << move << "\n";
     } else {
       std::cerr << "discarding unknown command: `" << line << "`\n";